@@ -20,6 +20,8 @@
 #include "../src/runtime/rpc/rpc_server_env.cc"
 #include "../src/runtime/rpc/rpc_module.cc"
 #include "../src/runtime/rpc/rpc_socket_impl.cc"
+#include "../src/runtime/rpc/rpc_shm_impl.cc"
+#include "../src/runtime/rpc/rpc_mux_impl.cc"
 #include "../src/runtime/thread_pool.cc"
 
 #include "../src/runtime/graph/graph_runtime.cc"
@@ -18,6 +18,8 @@
 #include "../../src/runtime/rpc/rpc_session.cc"
 #include "../../src/runtime/rpc/rpc_server_env.cc"
 #include "../../src/runtime/rpc/rpc_socket_impl.cc"
+#include "../../src/runtime/rpc/rpc_shm_impl.cc"
+#include "../../src/runtime/rpc/rpc_mux_impl.cc"
 #include "../../src/runtime/rpc/rpc_module.cc"
 // Graph runtime
 #include "../../src/runtime/graph/graph_runtime.cc"
@@ -97,7 +99,7 @@ void LaunchSyncServer() {
   int port;
   CHECK(fs >> url >> port >> key)
       << "Invalid RPC config file " << name;
-  RPCConnect(url, port, "server:" + key)
+  RPCConnect(url, port, "server:" + key, "tcp")
       ->ServerLoop();
 }
 
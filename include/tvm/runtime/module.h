@@ -159,6 +159,11 @@ constexpr const char* tvm_global_barrier_state = "__tvm_global_barrier_state";
 constexpr const char* tvm_prepare_global_barrier = "__tvm_prepare_global_barrier";
 /*! \brief Placeholder for the module's entry function. */
 constexpr const char* tvm_module_main = "__tvm_main__";
+/*!
+ * \brief Query of host modules, returns a function that maps a function
+ *  name to the address of its BackendPackedCFunc, or nullptr.
+ */
+constexpr const char* tvm_get_backend_func_addr = "__tvm_get_backend_func_addr";
 }  // namespace symbol
 
 // implementations of inline functions.
@@ -0,0 +1,238 @@
+"""Request coalescing front-end of graph runtime.
+
+Serving single-sample requests one by one leaves kernels built for larger
+batches underused. GraphBatcher queues the requests, packs up to
+max_batch_size of them into one batched input, runs the graph once
+and scatters the outputs back to each request.
+
+The graph takes the batch as the leading dimension of every input and
+output. Graphs with a symbolic batch dimension run with the actual batch
+size, other graphs get their batch padded to max_batch_size.
+"""
+from __future__ import absolute_import
+
+import threading
+import time
+from collections import deque
+
+import numpy as np
+from .. import ndarray as nd
+
+
+class BatchFuture(object):
+    """Result of a request submitted to GraphBatcher."""
+    def __init__(self):
+        self._event = threading.Event()
+        self._result = None
+        self._error = None
+
+    def _set(self, result=None, error=None):
+        self._result = result
+        self._error = error
+        self._event.set()
+
+    def done(self):
+        """Whether the request has finished."""
+        return self._event.is_set()
+
+    def result(self, timeout=None):
+        """Wait for the outputs of the request.
+
+        Parameters
+        ----------
+        timeout : float, optional
+            Maximum seconds to wait, None waits forever.
+
+        Returns
+        -------
+        outputs : list of numpy.ndarray
+            The outputs of the sample, without the batch dimension.
+        """
+        if not self._event.wait(timeout):
+            raise RuntimeError("Request is not finished in %s seconds" % timeout)
+        if self._error is not None:
+            raise self._error
+        return self._result
+
+
+class GraphBatcher(object):
+    """Coalesce single-sample requests into batched graph runs.
+
+    Parameters
+    ----------
+    module : GraphModule
+        The graph module created by graph_runtime.create.
+
+    input_names : list of str
+        Names of the inputs that carry the batch dimension. Other inputs,
+        e.g. the parameters, are set on the module beforehand.
+
+    output_shapes : list of tuple
+        Shape of each output for one sample, without the batch dimension.
+
+    output_dtypes : list of str, optional
+        Type of each output, float32 by default.
+
+    max_batch_size : int, optional
+        Maximum number of requests per run.
+
+    timeout_ms : float, optional
+        How long the first request of a batch waits for more requests.
+
+    dynamic_batch : bool, optional
+        Whether the graph has a symbolic batch dimension and runs with
+        set_batch_size, otherwise batches are padded to max_batch_size.
+
+    latency_window : int, optional
+        Number of latest requests the latency percentiles are taken over.
+    """
+    def __init__(self, module, input_names, output_shapes,
+                 output_dtypes=None, max_batch_size=8, timeout_ms=2.0,
+                 dynamic_batch=False, latency_window=1024):
+        if max_batch_size < 1:
+            raise ValueError("max_batch_size must be positive")
+        if latency_window < 1:
+            raise ValueError("latency_window must be positive")
+        self.module = module
+        self.input_names = list(input_names)
+        self.output_shapes = [tuple(shape) for shape in output_shapes]
+        self.output_dtypes = list(output_dtypes or ["float32"] * len(self.output_shapes))
+        self.max_batch_size = max_batch_size
+        self.timeout_ms = timeout_ms
+        self.dynamic_batch = dynamic_batch
+        self._queue = deque()
+        self._cond = threading.Condition()
+        self._closed = False
+        self._latency = deque(maxlen=latency_window)
+        self._num_requests = 0
+        self._num_batches = 0
+        self._latency_sum = 0.0
+        self._start_time = time.time()
+        self._thread = threading.Thread(target=self._loop)
+        self._thread.daemon = True
+        self._thread.start()
+
+    def submit(self, **inputs):
+        """Queue one sample.
+
+        Parameters
+        ----------
+        inputs : dict of str to numpy.ndarray
+            One value per name in input_names, without the batch dimension.
+
+        Returns
+        -------
+        future : BatchFuture
+            The future of the outputs.
+        """
+        missing = [name for name in self.input_names if name not in inputs]
+        if missing:
+            raise ValueError("Missing inputs %s" % missing)
+        future = BatchFuture()
+        with self._cond:
+            if self._closed:
+                raise RuntimeError("GraphBatcher is closed")
+            self._queue.append((time.time(), inputs, future))
+            self._cond.notify()
+        return future
+
+    def run(self, **inputs):
+        """Submit one sample and wait for its outputs."""
+        return self.submit(**inputs).result()
+
+    def close(self):
+        """Finish the queued requests and stop the worker thread."""
+        with self._cond:
+            self._closed = True
+            self._cond.notify()
+        self._thread.join()
+
+    def stats(self):
+        """Get the latency and throughput counters.
+
+        Returns
+        -------
+        stats : dict
+            num_requests, num_batches, mean_batch_size, throughput
+            (requests per second since creation) and the mean of the
+            request latency in milliseconds. The p50 and p99 latency
+            are taken over the latest latency_samples requests, at most
+            latency_window of them.
+        """
+        with self._cond:
+            latency = sorted(self._latency)
+            num_requests = self._num_requests
+            num_batches = self._num_batches
+            latency_sum = self._latency_sum
+        elapsed = max(time.time() - self._start_time, 1e-9)
+        def percentile(q):
+            if not latency:
+                return 0.0
+            return latency[min(len(latency) - 1, int(q * len(latency)))]
+        return {
+            "num_requests": num_requests,
+            "num_batches": num_batches,
+            "mean_batch_size": float(num_requests) / max(num_batches, 1),
+            "throughput": num_requests / elapsed,
+            "latency_mean_ms": latency_sum / max(num_requests, 1),
+            "latency_p50_ms": percentile(0.5),
+            "latency_p99_ms": percentile(0.99),
+            "latency_samples": len(latency),
+        }
+
+    def _next_batch(self):
+        """Wait for a batch, return None when closed and drained."""
+        with self._cond:
+            while not self._queue and not self._closed:
+                self._cond.wait()
+            if not self._queue:
+                return None
+            deadline = self._queue[0][0] + self.timeout_ms / 1000.0
+            while len(self._queue) < self.max_batch_size and not self._closed:
+                remain = deadline - time.time()
+                if remain <= 0:
+                    break
+                self._cond.wait(remain)
+            num = min(len(self._queue), self.max_batch_size)
+            return [self._queue.popleft() for _ in range(num)]
+
+    def _run_batch(self, batch):
+        num = len(batch)
+        padded = num if self.dynamic_batch else self.max_batch_size
+        if self.dynamic_batch:
+            self.module.set_batch_size(num)
+        for name in self.input_names:
+            samples = [np.asarray(req[1][name]) for req in batch]
+            data = np.zeros((padded,) + samples[0].shape, dtype=samples[0].dtype)
+            for i, sample in enumerate(samples):
+                data[i] = sample
+            self.module.set_input(name, data)
+        self.module.run()
+        outputs = []
+        for i, (shape, dtype) in enumerate(zip(self.output_shapes, self.output_dtypes)):
+            out = self.module.get_output(i, nd.empty((padded,) + shape, dtype))
+            outputs.append(out.asnumpy())
+        return [[out[k] for out in outputs] for k in range(num)]
+
+    def _loop(self):
+        while True:
+            batch = self._next_batch()
+            if batch is None:
+                return
+            try:
+                results = self._run_batch(batch)
+                errors = [None] * len(batch)
+            except Exception as err:  # pylint: disable=broad-except
+                results = [None] * len(batch)
+                errors = [err] * len(batch)
+            finish = time.time()
+            with self._cond:
+                self._num_batches += 1
+                self._num_requests += len(batch)
+                for req in batch:
+                    latency = (finish - req[0]) * 1000.0
+                    self._latency_sum += latency
+                    self._latency.append(latency)
+            for req, result, error in zip(batch, results, errors):
+                req[2]._set(result, error)
+
@@ -1,8 +1,12 @@
 """Minimum graph runtime that executes graph containing TVM PackedFunc."""
+import json
+import struct
+import numpy as np
 from . import rpc
 from .._ffi.base import string_types
 from .._ffi.function import get_global_func
 from .. import ndarray as nd
+from .. import module as _module
 
 
 def create(graph_json_str, libmod, ctx):
@@ -10,38 +14,283 @@ def create(graph_json_str, libmod, ctx):
 
     Parameters
     ----------
-    graph_json_str : str or graph class
+    graph_json_str : str or graph class or bytearray
         The graph to be deployed in json format output by nnvm graph.
         The graph can only contain one operator(tvm_op) that
         points to the name of PackedFunc in the libmod.
+        A bytearray is treated as a binary graph produced by
+        convert_to_binary.
 
     libmod : tvm.Module
         The module of the corresponding function
 
-    ctx : TVMContext
+    ctx : TVMContext or list of TVMContext
         The context to deploy the module, can be local or remote.
+        A list of contexts runs a heterogeneous graph, the device_index
+        attribute of each node indexes into the list.
 
     Returns
     -------
     graph_module : GraphModule
         Runtime graph module that can be used to execute the graph.
     """
-    if not isinstance(graph_json_str, string_types):
+    if isinstance(graph_json_str, (bytes, bytearray)) and \
+            not isinstance(graph_json_str, string_types):
+        graph_json_str = bytearray(graph_json_str)
+    elif not isinstance(graph_json_str, string_types):
         try:
             graph_json_str = graph_json_str._tvm_graph_json()
         except AttributeError:
             raise ValueError("Type %s is not supported" % type(graph_json_str))
-    device_type = ctx.device_type
-    device_id = ctx.device_id
-    if device_type >= rpc.RPC_SESS_MASK:
+    ctxs = ctx if isinstance(ctx, (list, tuple)) else [ctx]
+    if not ctxs:
+        raise ValueError("At least one context is required")
+    ctx_args = []
+    if ctxs[0].device_type >= rpc.RPC_SESS_MASK:
         assert libmod.type_key == "rpc"
-        assert rpc._SessTableIndex(libmod) == ctx._rpc_sess._tbl_index
+        assert rpc._SessTableIndex(libmod) == ctxs[0]._rpc_sess._tbl_index
+        for c in ctxs:
+            assert c.device_type >= rpc.RPC_SESS_MASK
+            assert c._rpc_sess._tbl_index == ctxs[0]._rpc_sess._tbl_index
+            ctx_args += [c.device_type % rpc.RPC_SESS_MASK, c.device_id]
         hmod = rpc._ModuleHandle(libmod)
-        fcreate = ctx._rpc_sess.get_function("tvm.graph_runtime.remote_create")
-        device_type = device_type % rpc.RPC_SESS_MASK
-        return GraphModule(fcreate(graph_json_str, hmod, device_type, device_id), ctx)
+        fcreate = ctxs[0]._rpc_sess.get_function("tvm.graph_runtime.remote_create")
+        return GraphModule(fcreate(graph_json_str, hmod, *ctx_args), ctxs[0])
+    for c in ctxs:
+        assert c.device_type < rpc.RPC_SESS_MASK
+        ctx_args += [c.device_type, c.device_id]
     fcreate = get_global_func("tvm.graph_runtime.create")
-    return GraphModule(fcreate(graph_json_str, libmod, device_type, device_id), ctx)
+    return GraphModule(fcreate(graph_json_str, libmod, *ctx_args), ctxs[0])
+
+def export_deploy(graph_module, lib, file_name, **kwargs):
+    """Export a graph module and its operators as one library.
+
+    The graph in binary format, the execution order, the memory plan
+    and the current value of every input, e.g. the loaded params, are
+    packed into the data section of the library, next to the device
+    code. load_deploy sets up the executor from it without parsing the
+    graph or planning the memory.
+
+    Parameters
+    ----------
+    graph_module : GraphModule
+        The local graph module, created from lib.
+
+    lib : tvm.Module
+        The llvm module of the operators, the artifact is imported into it.
+
+    file_name : str
+        The name of the shared library.
+
+    kwargs : dict, optional
+        Additional arguments passed to export_library.
+    """
+    fartifact = get_global_func("tvm.graph_runtime.deploy_artifact")
+    lib.import_module(fartifact(graph_module.module["save_deploy"]()))
+    lib.export_library(file_name, **kwargs)
+
+
+def load_deploy(lib, ctx):
+    """Create a graph module from a library written by export_deploy.
+
+    Parameters
+    ----------
+    lib : str or tvm.Module
+        The path of the library, or the library loaded locally or remotely.
+
+    ctx : TVMContext or list of TVMContext
+        The context to deploy the module, can be local or remote.
+
+    Returns
+    -------
+    graph_module : GraphModule
+        Runtime graph module that can be used to execute the graph.
+    """
+    if isinstance(lib, string_types):
+        lib = _module.load(lib)
+    ctxs = ctx if isinstance(ctx, (list, tuple)) else [ctx]
+    if not ctxs:
+        raise ValueError("At least one context is required")
+    ctx_args = []
+    if ctxs[0].device_type >= rpc.RPC_SESS_MASK:
+        assert lib.type_key == "rpc"
+        for c in ctxs:
+            assert c._rpc_sess._tbl_index == ctxs[0]._rpc_sess._tbl_index
+            ctx_args += [c.device_type % rpc.RPC_SESS_MASK, c.device_id]
+        fcreate = ctxs[0]._rpc_sess.get_function("tvm.graph_runtime.remote_create_deploy")
+        return GraphModule(fcreate(rpc._ModuleHandle(lib), *ctx_args), ctxs[0])
+    for c in ctxs:
+        ctx_args += [c.device_type, c.device_id]
+    fcreate = get_global_func("tvm.graph_runtime.create_deploy")
+    return GraphModule(fcreate(lib, *ctx_args), ctxs[0])
+
+
+class SharedArena(object):
+    """Activation memory shared by the graph modules of one process.
+
+    Parameters
+    ----------
+    module : Module
+        The internal module of the arena.
+
+    ctx : TVMContext
+        The context of the arena.
+    """
+    def __init__(self, module, ctx):
+        self.module = module
+        self.ctx = ctx
+        self._stats = module["stats"]
+
+    def stats(self):
+        """Get the counters of the arena.
+
+        Returns
+        -------
+        stats : dict
+            capacity_bytes, allocated_bytes, num_blocks, num_leases,
+            num_hits (leases served by the block the module kept),
+            num_allocs, num_evictions and num_waits.
+        """
+        return json.loads(self._stats())
+
+
+def shared_arena(ctx, capacity_bytes):
+    """Create an activation arena to share among graph modules.
+
+    Each module that uses the arena leases one block for its activations
+    while it runs, so the memory is bounded by the modules that run at
+    the same time rather than by all the loaded modules.
+
+    Parameters
+    ----------
+    ctx : TVMContext
+        The context of the arena, can be local or remote.
+
+    capacity_bytes : int
+        The maximum number of bytes allocated by the arena. A run waits
+        until enough memory is released by the other modules.
+
+    Returns
+    -------
+    arena : SharedArena
+        The arena, pass it to GraphModule.use_shared_arena.
+    """
+    if ctx.device_type >= rpc.RPC_SESS_MASK:
+        fcreate = ctx._rpc_sess.get_function("tvm.graph_runtime.shared_arena")
+        device_type = ctx.device_type % rpc.RPC_SESS_MASK
+    else:
+        fcreate = get_global_func("tvm.graph_runtime.shared_arena")
+        device_type = ctx.device_type
+    return SharedArena(fcreate(capacity_bytes, device_type, ctx.device_id), ctx)
+
+
+def convert_to_binary(graph_json_str):
+    """Convert a json graph into the binary graph format.
+
+    The binary format stores nodes, entries and attributes as
+    fixed-width records, which makes graph loading much cheaper
+    than parsing json on small devices.
+
+    Parameters
+    ----------
+    graph_json_str : str or graph class
+        The graph in json format.
+
+    Returns
+    -------
+    blob : bytearray
+        The binary graph, can be passed to create directly.
+    """
+    if not isinstance(graph_json_str, string_types):
+        try:
+            graph_json_str = graph_json_str._tvm_graph_json()
+        except AttributeError:
+            raise ValueError("Type %s is not supported" % type(graph_json_str))
+    fconvert = get_global_func("tvm.graph_runtime.convert_to_binary")
+    return fconvert(graph_json_str)
+
+
+# Magic numbers of the parameter file, see src/runtime/graph/graph_runtime.h
+_NDARRAY_LIST_MAGIC = 0xF7E58D4F05049CB7
+_NDARRAY_MAGIC = 0xDD5E40F096B4A13F
+_QUANTIZED_NDARRAY_MAGIC = 0x3C7A96E1D05F42B8
+
+
+def save_quantized_params(params, dtype="int8", axis=0):
+    """Serialize a parameter dict with float32 tensors compressed.
+
+    int8 tensors are quantized symmetrically with one float32 scale per
+    channel along axis. float16 tensors are stored without scales.
+    The runtime expands them back when the graph input is float32, or
+    loads the compressed data as is when the graph input has the
+    compressed dtype. In that case the int8 scales of param ``name`` are
+    loaded into the float32 graph input ``name_scale``, and loading fails
+    when the graph has no such input. Tensors of other dtypes are stored
+    unchanged.
+
+    Parameters
+    ----------
+    params : dict of str to numpy.ndarray or NDArray
+        The parameters.
+
+    dtype : {"int8", "float16"}
+        The storage type of float32 parameters.
+
+    axis : int, optional
+        The channel axis of the int8 scales, None for one scale per tensor.
+
+    Returns
+    -------
+    params_bytes : bytearray
+        The serialized parameters, can be passed to load_params.
+    """
+    if dtype not in ("int8", "float16"):
+        raise ValueError("Unsupported quantized dtype %s" % dtype)
+    type_codes = {"i": 0, "u": 1, "f": 2}
+
+    def pack_dtype(arr_dtype):
+        return struct.pack("<BBH", type_codes[arr_dtype.kind], arr_dtype.itemsize * 8, 1)
+
+    blob = bytearray(struct.pack("<QQ", _NDARRAY_LIST_MAGIC, 0))
+    names = sorted(params.keys())
+    blob += struct.pack("<Q", len(names))
+    for name in names:
+        data = name.encode("utf-8")
+        blob += struct.pack("<Q", len(data)) + data
+    blob += struct.pack("<Q", len(names))
+    for name in names:
+        arr = params[name]
+        arr = np.ascontiguousarray(arr.asnumpy() if hasattr(arr, "asnumpy") else arr)
+        # the device (kDLCPU, 0) and the shape
+        header = struct.pack("<iii", 1, 0, arr.ndim)
+        shape = struct.pack("<%dq" % arr.ndim, *arr.shape)
+        if arr.dtype != np.float32:
+            blob += struct.pack("<QQ", _NDARRAY_MAGIC, 0) + header
+            blob += pack_dtype(arr.dtype) + shape
+            blob += struct.pack("<Q", arr.nbytes) + arr.tobytes()
+            continue
+        scales = np.zeros((0,), dtype="float32")
+        chan_axis = 0
+        if dtype == "int8":
+            if axis is None or arr.ndim == 0:
+                absmax = np.abs(arr).max(keepdims=True).reshape((1,))
+            else:
+                chan_axis = axis % arr.ndim
+                reduce_axes = tuple(i for i in range(arr.ndim) if i != chan_axis)
+                absmax = np.abs(arr).max(axis=reduce_axes) if reduce_axes else np.abs(arr)
+            scales = (absmax / 127.0).astype("float32")
+            scales[scales == 0] = 1.0
+            bshape = [1] * arr.ndim
+            if arr.ndim != 0 and scales.size > 1:
+                bshape[chan_axis] = scales.size
+            data = np.clip(np.round(arr / scales.reshape(bshape)), -127, 127).astype("int8")
+        else:
+            data = arr.astype("float16")
+        blob += struct.pack("<QQ", _QUANTIZED_NDARRAY_MAGIC, 0) + header
+        blob += pack_dtype(data.dtype) + shape
+        blob += struct.pack("<iQ", chan_axis, scales.size) + scales.tobytes()
+        blob += struct.pack("<Q", data.nbytes) + data.tobytes()
+    return blob
 
 
 class GraphModule(object):
@@ -79,6 +328,20 @@ class GraphModule(object):
         self._load_params = module["load_params"]
         self.ctx = ctx
 
+    # Functions of newer runtimes, looked up on first use so that the
+    # module of an older remote runtime can still be wrapped.
+    _LAZY_FUNCS = frozenset([
+        "set_batch_size", "set_output_callback", "output_valid", "profile",
+        "plan_memory", "fuse_shape_ops", "memory_footprint", "use_shared_arena", "optimize_order",
+        "compile_run_plan", "warmup", "save_warm_state", "load_warm_state"])
+
+    def __getattr__(self, name):
+        if name.startswith("_") and name[1:] in GraphModule._LAZY_FUNCS:
+            func = self.module[name[1:]]
+            setattr(self, name, func)
+            return func
+        raise AttributeError(name)
+
     def set_input(self, key=None, value=None, **params):
         """Set inputs to the module via kwargs
 
@@ -125,6 +388,49 @@ class GraphModule(object):
         self._get_output(index, out)
         return out
 
+    def output_valid(self, index):
+        """Whether the last run computed the index-th output.
+
+        Nodes can be gated by the scalar output of another node through
+        the gate graph attribute. Outputs behind a gate that was zero in
+        the last run are not computed and keep stale content.
+
+        Parameters
+        ----------
+        index : int
+            The output index
+
+        Returns
+        -------
+        valid : bool
+            Whether the output is up to date.
+        """
+        return bool(self._output_valid(index))
+
+    def use_shared_arena(self, arena, pin=False):
+        """Lease the activations from a shared arena at each run.
+
+        The inputs and outputs keep their own memory, the intermediate
+        entries are planned into one block that is leased from the arena
+        when the graph runs and released after it.
+
+        Parameters
+        ----------
+        arena : SharedArena or None
+            The arena, None to own the activations again.
+
+        pin : bool, optional
+            Whether to keep the block between runs. A pinned module skips
+            rebinding its operators as long as the block is not evicted,
+            the least recently used blocks are evicted first.
+        """
+        if arena is None:
+            self._use_shared_arena(None, pin)
+        elif self.ctx.device_type >= rpc.RPC_SESS_MASK:
+            self._use_shared_arena(rpc._ModuleHandle(arena.module), pin)
+        else:
+            self._use_shared_arena(arena.module, pin)
+
     def debug_get_output(self, node, out):
         """Run graph upto node and get the output to out
 
@@ -142,6 +448,205 @@ class GraphModule(object):
             raise RuntimeError("Please compile runtime with USE_GRAPH_RUNTIME_DEBUG = 0")
         return out
 
+    def set_output_callback(self, index, callback):
+        """Register a function called as soon as an output is computed.
+
+        The callback runs during run, right after the node that produces
+        the output, so post-processing of early outputs can start before
+        the rest of the graph finishes.
+
+        Parameters
+        ----------
+        index : int
+            The output index.
+
+        callback : function(index, NDArray) or None
+            The function called with the output index and a view of the
+            output, the view is only valid during the call. None removes
+            the callback.
+        """
+        self._set_output_callback(index, callback)
+        return self
+
+    def set_batch_size(self, batch_size):
+        """Set the batch size of a graph with symbolic batch dimension.
+
+        The graph marks the batch dimension as -1 in its shapes and
+        provides max_batch_size, the storage is planned for the maximum
+        batch and reused by smaller batches.
+
+        Parameters
+        ----------
+        batch_size : int
+            The batch size of the following runs.
+        """
+        self._set_batch_size(batch_size)
+        return self
+
+    def profile(self, number=10, warmup=1):
+        """Measure the execution time of each operator node.
+
+        The inputs need to be set before calling this function.
+
+        Parameters
+        ----------
+        number : int, optional
+            Number of measured runs of the graph.
+
+        warmup : int, optional
+            Number of runs before the measurement starts.
+
+        Returns
+        -------
+        records : list of dict
+            One record per operator node, with keys node_id, name,
+            func_name, time_us (mean over the runs of the node), num_runs,
+            bytes_read and bytes_written. Nodes behind closed gates are
+            skipped as in run.
+        """
+        return json.loads(self._profile(number, warmup))
+
+    def fuse_shape_ops(self, alignment=64):
+        """Skip the copy kernels of shape-only operators.
+
+        Operators named like reshape, flatten, squeeze or expand_dims,
+        e.g. fuse_reshape_1, become views of their inputs. This replaces
+        the storage plan of the graph by a runtime memory plan as
+        plan_memory does, and drops a compiled run plan.
+
+        Parameters
+        ----------
+        alignment : int, optional
+            The alignment in bytes of each entry in the arena.
+
+        Returns
+        -------
+        num_fused : int
+            The number of rewritten operators, the memory plan is kept
+            when it is zero.
+        """
+        return self._fuse_shape_ops(alignment)
+
+    def plan_memory(self, alignment=64):
+        """Replace the storage plan of the graph by a runtime memory plan.
+
+        Liveness is recomputed from the graph and all activations are
+        packed into a single arena. An operator never writes its output
+        over its own inputs, since kernels are not known to be safe with
+        aliased arguments. Values already set to the inputs are kept.
+
+        Parameters
+        ----------
+        alignment : int, optional
+            The byte alignment of each tensor in the arena.
+
+        Returns
+        -------
+        nbytes : int
+            The size of the arena in bytes.
+        """
+        return self._plan_memory(alignment)
+
+    def optimize_order(self, alignment=64):
+        """Reorder the operators to keep fewer activation bytes live.
+
+        A topological order is chosen greedily from the tensor sizes,
+        preferring consumers of recently produced tensors, and the memory
+        is planned for it like plan_memory. The original order and its
+        storage are kept if the new order is the same or not better.
+
+        Parameters
+        ----------
+        alignment : int, optional
+            The byte alignment of each tensor in the arena.
+
+        Returns
+        -------
+        report : dict
+            Whether the graph was reordered, the estimated peak live bytes
+            and the total producer to consumer distance before and after,
+            and the size of the planned arena, or the current storage when
+            the graph was not reordered.
+        """
+        return json.loads(self._optimize_order(alignment))
+
+    def compile_run_plan(self):
+        """Compile the executor into a flat plan of direct kernel calls.
+
+        Each operator calls the backend function of the module with its
+        argument block packed ahead of time, which removes the dispatch
+        overhead of graphs with many small operators. The plan is
+        checked against the normal executor on the current inputs and
+        only used by run if the outputs match.
+
+        Returns
+        -------
+        report : dict
+            num_steps, num_direct (operators called without PackedFunc)
+            and validated.
+        """
+        return json.loads(self._compile_run_plan())
+
+    def memory_footprint(self):
+        """Get the number of bytes held by the graph storage.
+
+        Returns
+        -------
+        nbytes : int
+            The total size of the storage pool in bytes.
+        """
+        return self._memory_footprint()
+
+    def warmup(self, number=2, fill_value=0.0):
+        """Warm up the graph so that the first request runs at steady state.
+
+        Every buffer is written to fault in its pages, then the graph runs
+        number times on inputs filled with fill_value. The workspace used
+        by the first run on the calling thread is kept as the warm state,
+        allocations made by parallel tasks on the thread pool are not
+        recorded. Inputs that were set before, including the parameters,
+        are restored afterwards.
+
+        Parameters
+        ----------
+        number : int, optional
+            Number of synthetic runs.
+
+        fill_value : float, optional
+            The value of every synthetic input element.
+
+        Returns
+        -------
+        report : dict
+            Time in microseconds of prefault_us, first_run_us and run_us
+            (mean of the later runs), and the storage_bytes and
+            workspace_bytes touched.
+        """
+        return json.loads(self._warmup(number, float(fill_value)))
+
+    def save_warm_state(self):
+        """Serialize the warm state recorded by warmup.
+
+        Returns
+        -------
+        state : bytearray
+            The workspace allocations of a warm run.
+        """
+        return self._save_warm_state()
+
+    def load_warm_state(self, state):
+        """Restore a warm state saved by save_warm_state.
+
+        The recorded workspace is allocated and released on the calling
+        thread, so that its workspace pool is ready for the first run.
+
+        Parameters
+        ----------
+        state : bytearray
+            The saved warm state.
+        """
+        self._load_warm_state(bytearray(state))
+
     def load_params(self, params_bytes):
         """Load parameters from serialized byte array of parameter dict.
 
@@ -11,6 +11,8 @@ upload and run remote RPC server, get the result back to verify correctness.
 from __future__ import absolute_import
 
 import os
+import re
+import hashlib
 import socket
 import struct
 import logging
@@ -24,42 +26,102 @@ from .._ffi.ndarray import context as _context
 from .._ffi.base import py_str
 
 RPC_MAGIC = 0xff271
+RPC_SHM_FLAG = 0x100
+RPC_MUX_FLAG = 0x200
 RPC_SESS_MASK = 128
+RPC_CODECS = {"none": 0, "byteplane_rle": 1}
+# Names of the files in the module cache: the sha256 of the content
+# and the extension of the uploaded file.
+_CACHE_NAME = re.compile(r"^[0-9a-f]{64}(\.\w+)?$")
 
-def _server_env():
+def _server_env(cache_dir=None):
     """Server environment function return temp dir"""
     temp = util.tempdir()
+    # modules loaded from the cache, by the path of the cached file.
+    cached_modules = {}
     # pylint: disable=unused-variable
     @register_func("tvm.contrib.rpc.server.workpath")
     def get_workpath(path):
         return temp.relpath(path)
 
+    @register_func("tvm.contrib.rpc.server.cache_lookup", override=True)
+    def cache_lookup(name, target):
+        """Link the cached file name to target, return whether it is cached."""
+        if not cache_dir or not _CACHE_NAME.match(name):
+            return False
+        path = os.path.join(cache_dir, name)
+        if not os.path.exists(path):
+            return False
+        if os.path.lexists(temp.relpath(target)):
+            os.remove(temp.relpath(target))
+        os.symlink(path, temp.relpath(target))
+        logging.info("Cache hit %s as %s", name, target)
+        return True
+
+    @register_func("tvm.contrib.rpc.server.cache_upload", override=True)
+    def cache_upload(name, target, blob):
+        """Add a file to the cache and link it to target."""
+        if not cache_dir:
+            with open(temp.relpath(target), "wb") as out_file:
+                out_file.write(blob)
+            return
+        if not _CACHE_NAME.match(name):
+            raise ValueError("invalid cache name %s" % name)
+        if hashlib.sha256(blob).hexdigest() != name.split(".")[0]:
+            raise ValueError("content of %s does not match its hash" % name)
+        # concurrent sessions may upload the same file.
+        tmp_path = os.path.join(cache_dir, "%s.%d.tmp" % (name, os.getpid()))
+        with open(tmp_path, "wb") as out_file:
+            out_file.write(blob)
+        os.rename(tmp_path, os.path.join(cache_dir, name))
+        logging.info("Cache add %s nbytes=%d", name, len(blob))
+        cache_lookup(name, target)
+
     @register_func("tvm.contrib.rpc.server.load_module", override=True)
     def load_module(file_name):
         """Load module from remote side."""
         path = temp.relpath(file_name)
+        real_path = os.path.realpath(path)
+        cached = cache_dir is not None and os.path.dirname(real_path) == cache_dir
+        if cached and real_path in cached_modules:
+            logging.info("load_module %s from cache", path)
+            return cached_modules[real_path]
+        # the shared library of a cached file is created once.
+        lib_path = (real_path if cached else path) + ".so"
+        tmp_lib_path = lib_path + (".%d.tmp" % os.getpid() if cached else "")
         # Try create a shared library in remote
         if path.endswith(".o"):
-            logging.info("Create shared library based on %s", path)
-            cc.create_shared(path + ".so", path)
-            path += ".so"
+            if not (cached and os.path.exists(lib_path)):
+                logging.info("Create shared library based on %s", path)
+                cc.create_shared(tmp_lib_path, path)
+                os.rename(tmp_lib_path, lib_path)
+            path = lib_path
         elif path.endswith(".tar"):
-            tar_temp = util.tempdir()
-            tar.untar(path, tar_temp.temp_dir)
-            files = [tar_temp.relpath(x) for x in tar_temp.listdir()]
-            cc.create_shared(path + ".so", files)
-            path += ".so"
+            if not (cached and os.path.exists(lib_path)):
+                tar_temp = util.tempdir()
+                tar.untar(path, tar_temp.temp_dir)
+                files = [tar_temp.relpath(x) for x in tar_temp.listdir()]
+                cc.create_shared(tmp_lib_path, files)
+                os.rename(tmp_lib_path, lib_path)
+            path = lib_path
         m = _load_module(path)
         logging.info("load_module %s", path)
+        if cached:
+            cached_modules[real_path] = m
         return m
     return temp
 
 
-def _serve_loop(sock, addr):
+def _serve_loop(sock, addr, shm_name=None, multiplex=False, cache_dir=None):
     """Server loop"""
     sockfd = sock.fileno()
-    temp = _server_env()
-    _ServerLoop(sockfd)
+    temp = _server_env(cache_dir)
+    if multiplex:
+        _ServerLoopMux(sockfd, shm_name or "")
+    elif shm_name:
+        _ServerLoopShm(sockfd, shm_name)
+    else:
+        _ServerLoop(sockfd)
     temp.remove()
     logging.info("Finish serving %s", addr)
 
@@ -74,7 +136,29 @@ def _recvall(sock, nbytes):
     return b"".join(res)
 
 
-def _listen_loop(sock, exclusive):
+def _recv_handshake(conn):
+    """Receive the hand shake of a client.
+
+    Returns
+    -------
+    handshake : tuple of (int, str, str)
+        The magic flags, the key and the shared memory name or None,
+        None if the peer is not an RPC client.
+    """
+    magic = struct.unpack("@i", _recvall(conn, 4))[0]
+    flags = magic - RPC_MAGIC
+    if flags & ~(RPC_SHM_FLAG | RPC_MUX_FLAG):
+        return None
+    keylen = struct.unpack("@i", _recvall(conn, 4))[0]
+    key = py_str(_recvall(conn, keylen))
+    shm_name = None
+    if flags & RPC_SHM_FLAG:
+        namelen = struct.unpack("@i", _recvall(conn, 4))[0]
+        shm_name = py_str(_recvall(conn, namelen))
+    return flags, key, shm_name
+
+
+def _listen_loop(sock, exclusive, use_shm=False, cache_dir=None):
     """Lisenting loop"""
     last_proc = None
     while True:
@@ -85,19 +169,26 @@ def _listen_loop(sock, exclusive):
             last_proc.terminate()
 
         logging.info("RPCServer: connection from %s", addr)
-        magic = struct.unpack("@i", _recvall(conn, 4))[0]
-        if magic != RPC_MAGIC:
+        handshake = _recv_handshake(conn)
+        if handshake is None:
             conn.close()
             continue
-        keylen = struct.unpack("@i", _recvall(conn, 4))[0]
-        key = py_str(_recvall(conn, keylen))
+        flags, key, shm_name = handshake
         if not key.startswith("client:"):
             conn.sendall(struct.pack("@i", RPC_MAGIC + 2))
+        elif shm_name and not use_shm:
+            conn.sendall(struct.pack("@i", RPC_MAGIC + 3))
         else:
             conn.sendall(struct.pack("@i", RPC_MAGIC))
+        if shm_name and not (use_shm and key.startswith("client:")):
+            # the client removes the rejected segment.
+            conn.close()
+            continue
         logging.info("Connection from %s", addr)
 
-        process = multiprocessing.Process(target=_serve_loop, args=(conn, addr))
+        process = multiprocessing.Process(
+            target=_serve_loop,
+            args=(conn, addr, shm_name, bool(flags & RPC_MUX_FLAG), cache_dir))
         process.deamon = True
         process.start()
         last_proc = process
@@ -105,7 +196,7 @@ def _listen_loop(sock, exclusive):
         conn.close()
 
 
-def _connect_proxy_loop(addr, key):
+def _connect_proxy_loop(addr, key, cache_dir=None):
     key = "server:" + key
     while True:
         sock = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
@@ -121,7 +212,8 @@ def _connect_proxy_loop(addr, key):
         elif magic != RPC_MAGIC:
             raise RuntimeError("%s is not RPC Proxy" % str(addr))
         logging.info("RPCProxy connected to %s", str(addr))
-        process = multiprocessing.Process(target=_serve_loop, args=(sock, addr))
+        process = multiprocessing.Process(
+            target=_serve_loop, args=(sock, addr, None, False, cache_dir))
         process.deamon = True
         process.start()
         process.join()
@@ -172,7 +264,24 @@ class Server(object):
         monopolize the hardware resource.
 
     key : str, optional
-        The key used to identify the server in Proxy connection.
+        The key used to identify the server in Proxy connection,
+        or at the tracker.
+
+    use_shm : bool, optional
+        Whether clients on the same host may connect with
+        transport="shm", which exchanges the messages through
+        shared memory instead of the socket.
+
+    tracker_addr : tuple of (str, int), optional
+        The address of an RPC tracker to register at under key.
+        The server then serves one session at a time, to the clients
+        the tracker hands it to.
+
+    cache_dir : str, optional
+        The directory of the module cache, where the files uploaded with
+        cache=True are kept by their content hash for the later sessions.
+        A temporary directory of the server by default, give a directory
+        to keep the cache across restarts.
     """
     def __init__(self,
                  host,
@@ -181,7 +290,10 @@ class Server(object):
                  is_proxy=False,
                  use_popen=False,
                  exclusive=False,
-                 key=""):
+                 key="",
+                 use_shm=False,
+                 tracker_addr=None,
+                 cache_dir=None):
         try:
             if _ServerLoop is None:
                 raise RuntimeError("Please compile with USE_RPC=1")
@@ -190,12 +302,26 @@ class Server(object):
         self.host = host
         self.port = port
         self.libs = []
+        self._cache_temp = None
+        if not use_popen:
+            if cache_dir is None:
+                self._cache_temp = util.tempdir()
+                cache_dir = self._cache_temp.temp_dir
+            elif not os.path.isdir(cache_dir):
+                os.makedirs(cache_dir)
+            cache_dir = os.path.realpath(cache_dir)
 
         if use_popen:
             cmd = ["python",
                    "-m", "tvm.exec.rpc_server",
                    "--host=%s" % host,
                    "--port=%s" % port]
+            if use_shm:
+                cmd.append("--use-shm")
+            if tracker_addr:
+                cmd += ["--tracker=%s:%d" % tracker_addr, "--key=%s" % key]
+            if cache_dir:
+                cmd.append("--cache-dir=%s" % cache_dir)
             self.proc = multiprocessing.Process(
                 target=subprocess.check_call, args=(cmd,))
             self.proc.deamon = True
@@ -219,13 +345,19 @@ class Server(object):
             logging.info("RPCServer: bind to %s:%d", host, self.port)
             sock.listen(1)
             self.sock = sock
-            self.proc = multiprocessing.Process(
-                target=_listen_loop, args=(self.sock, exclusive))
+            if tracker_addr:
+                from .rpc_tracker import _tracker_listen_loop
+                self.proc = multiprocessing.Process(
+                    target=_tracker_listen_loop,
+                    args=(self.sock, self.port, tracker_addr, key, use_shm, cache_dir))
+            else:
+                self.proc = multiprocessing.Process(
+                    target=_listen_loop, args=(self.sock, exclusive, use_shm, cache_dir))
             self.proc.deamon = True
             self.proc.start()
         else:
             self.proc = multiprocessing.Process(
-                target=_connect_proxy_loop, args=((host, port), key))
+                target=_connect_proxy_loop, args=((host, port), key, cache_dir))
             self.proc.deamon = True
             self.proc.start()
 
@@ -239,6 +371,37 @@ class Server(object):
         self.terminate()
 
 
+class RPCFuture(object):
+    """Result of an asynchronous remote call or copy.
+
+    Do not directly create the object, call RPCSession.get_async_function
+    or RPCSession.async_copy.
+    """
+    def __init__(self, fwait, keep_alive=None):
+        self._fwait = fwait
+        self._keep_alive = keep_alive
+        self._done = False
+        self._result = None
+
+    def done(self):
+        """Whether the reply has arrived, never blocks."""
+        return self._done or bool(self._fwait(False))
+
+    def result(self):
+        """Wait for the reply of the request.
+
+        Returns
+        -------
+        value : object
+            The return value of the remote function, None for copies.
+        """
+        if not self._done:
+            self._result = self._fwait(True)
+            self._done = True
+            self._keep_alive = None
+        return self._result
+
+
 class RPCSession(object):
     """RPC Client session module
 
@@ -265,6 +428,111 @@ class RPCSession(object):
         """
         return self._sess.get_function(name)
 
+    def get_async_function(self, name, module=None):
+        """Get a function that sends the call without waiting.
+
+        The requests of a session are served in order, so many calls
+        can be in flight and each costs no round trip of its own.
+
+        Parameters
+        ----------
+        name : str
+            The name of the function
+
+        module : Module, optional
+            The remote module that holds the function,
+            the global functions of the session by default.
+
+        Returns
+        -------
+        f : callable
+            Calling f sends the call and returns a RPCFuture.
+            The arguments are sent before f returns, remote arrays
+            passed in must stay alive until the call is done.
+        """
+        fasync = _AsyncFunction(module if module is not None else self._sess, name)
+        def _call(*args):
+            return RPCFuture(fasync(*args), args)
+        return _call
+
+    def async_copy(self, source, target):
+        """Copy between a local cpu array and a remote array without waiting.
+
+        Parameters
+        ----------
+        source : NDArray
+            The array to copy from.
+
+        target : NDArray
+            The array to copy to, one of source and target is remote.
+
+        Returns
+        -------
+        future : RPCFuture
+            The future of the copy. A local target is filled when the
+            future is done.
+        """
+        return RPCFuture(_AsyncCopy(source, target), (source, target))
+
+    def set_chunk_size(self, nbytes):
+        """Set the maximum bytes of each message of an array copy.
+
+        Larger copies are sent in chunks that are written into the
+        destination as they arrive, which bounds the buffers on both
+        sides and lets other calls go between the chunks of an
+        asynchronous copy.
+
+        Parameters
+        ----------
+        nbytes : int
+            The chunk size, 0 sends each copy as one message.
+        """
+        _SetChunkSize(self._sess, nbytes)
+
+    def set_compression(self, codec="byteplane_rle", threshold=4096):
+        """Negotiate the compression of bulk payloads with the server.
+
+        Array copies and byte arrays such as uploaded files of at least
+        threshold bytes are compressed in both directions. The
+        byteplane_rle codec groups the bytes of each 4-byte element by
+        position and run length encodes them, which suits float tensors
+        with repeated exponents or many zeros. It pays off on slow links,
+        over a fast network the encoding can cost more than it saves.
+
+        Parameters
+        ----------
+        codec : str
+            "byteplane_rle", or "none" to turn compression off.
+
+        threshold : int, optional
+            The minimum size in bytes of a compressed payload.
+
+        Returns
+        -------
+        accepted : bool
+            Whether the server supports the codec, False for servers
+            built before compression, which are not asked at all.
+        """
+        if codec not in RPC_CODECS:
+            raise ValueError("Unknown RPC codec %s" % codec)
+        code = RPC_CODECS[codec]
+        return _SetCompression(self._sess, code, threshold) == code
+
+    def new_session(self):
+        """Open another session over the connection of this one.
+
+        The connection must be made with multiplex=True. The sessions
+        run concurrently in threads of the same server process, so they
+        share the uploaded files, and a session can be closed without
+        closing the connection.
+
+        Returns
+        -------
+        sess : RPCSession
+            The new session.
+        """
+        return RPCSession(_NewSession(self._sess))
+
     def context(self, dev_type, dev_id=0):
         """Construct a remote context.
 
@@ -309,7 +577,7 @@ class RPCSession(object):
         """Construct remote extension device."""
         return self.context(12, dev_id)
 
-    def upload(self, data, target=None):
+    def upload(self, data, target=None, cache=False):
         """Upload file to remote runtime temp folder
 
         Parameters
@@ -319,6 +587,12 @@ class RPCSession(object):
 
         target : str, optional
             The path in remote
+
+        cache : bool, optional
+            Whether to go through the module cache of the server. Only
+            the hash of the content is sent when the server already has
+            it, and load_module reuses the modules loaded from the same
+            content, which saves the compilation of .o and .tar files.
         """
         if isinstance(data, bytearray):
             if not target:
@@ -329,11 +603,33 @@ class RPCSession(object):
             if not target:
                 target = os.path.basename(data)
 
+        if cache and self._upload_cached(target, blob):
+            return
         if "upload" not in self._remote_funcs:
             self._remote_funcs["upload"] = self.get_function(
                 "tvm.contrib.rpc.server.upload")
         self._remote_funcs["upload"](target, blob)
 
+    def _upload_cached(self, target, blob):
+        """Upload through the module cache, False if the server has none."""
+        if "cache_lookup" not in self._remote_funcs:
+            try:
+                self._remote_funcs["cache_lookup"] = self.get_function(
+                    "tvm.contrib.rpc.server.cache_lookup")
+                self._remote_funcs["cache_upload"] = self.get_function(
+                    "tvm.contrib.rpc.server.cache_upload")
+            except AttributeError:
+                self._remote_funcs["cache_lookup"] = None
+        if self._remote_funcs["cache_lookup"] is None:
+            return False
+        name = hashlib.sha256(blob).hexdigest() + os.path.splitext(target)[1]
+        if not _CACHE_NAME.match(name):
+            # the cache only keeps word extensions.
+            name = hashlib.sha256(blob).hexdigest()
+        if not self._remote_funcs["cache_lookup"](name, target):
+            self._remote_funcs["cache_upload"](name, target, blob)
+        return True
+
     def download(self, path):
         """Download file from remote temp folder.
 
@@ -368,7 +664,7 @@ class RPCSession(object):
         return _LoadRemoteModule(self._sess, path)
 
 
-def connect(url, port, key=""):
+def connect(url, port, key="", transport="tcp", multiplex=False):
     """Connect to RPC Server
 
     Parameters
@@ -382,13 +678,26 @@ def connect(url, port, key=""):
     key : str, optional
         Additional key to match server
 
+    transport : {"tcp", "shm"}, optional
+        How the messages are exchanged. "shm" uses a shared memory
+        ring buffer and needs a server on the same host started with
+        use_shm=True, the socket only carries the hand shake.
+
+    multiplex : bool, optional
+        Whether to multiplex sessions over the connection, so that
+        RPCSession.new_session opens more sessions on the same server
+        without a new connection. The server runs each of them in its
+        own thread.
+
     Returns
     -------
     sess : RPCSession
         The connected session.
     """
+    if transport not in ("tcp", "shm"):
+        raise ValueError("Unknown RPC transport %s" % transport)
     try:
-        sess = _Connect(url, port, key)
+        sess = _Connect(url, port, key, transport, multiplex)
     except NameError:
         raise RuntimeError("Please compile with USE_RPC=1")
     return RPCSession(sess)
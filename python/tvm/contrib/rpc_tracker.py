@@ -0,0 +1,531 @@
+"""RPC tracker, schedules the sessions of a pool of RPC servers.
+
+RPC servers register at the tracker under a key, such as the name
+of the board they run on. Clients ask the tracker for a session of
+a key instead of connecting to a server. The requests wait in a queue
+per key, ordered by priority then arrival, and get the server that has
+been idle for the longest time, so several jobs can share a pool of
+devices without colliding.
+
+Each free server registers with a fresh match key. The tracker hands the
+match key to one client, and the server only accepts that client. Once
+the session ends the server registers again, which tells the tracker
+that the device is free.
+"""
+# pylint: disable=invalid-name
+from __future__ import absolute_import
+
+import heapq
+import json
+import logging
+import multiprocessing
+import random
+import select
+import socket
+import struct
+import threading
+import time
+from . import rpc
+from .rpc import RPC_MAGIC, RPC_MUX_FLAG, _recv_handshake, _serve_loop
+from .._ffi.base import py_str
+
+RPC_TRACKER_MAGIC = 0x2f271
+
+# Seconds a server waits for the client it was handed to before it
+# registers again with a new match key.
+CLIENT_CONNECT_TIMEOUT = 30
+
+# Seconds between the checks of a waiting request for a closed client.
+CLIENT_POLL_INTERVAL = 1.0
+
+
+class TrackerCode(object):
+    """Codes of the tracker messages."""
+    FAIL = -1
+    SUCCESS = 0
+    PUT = 1
+    REQUEST = 2
+    SUMMARY = 3
+    ASSIGNED = 4
+
+
+def _send_msg(sock, value):
+    data = json.dumps(value).encode("utf-8")
+    sock.sendall(struct.pack("@i", len(data)))
+    sock.sendall(data)
+
+
+def _recvall(sock, nbytes):
+    """Receive nbytes, fewer when the peer closes."""
+    res = []
+    nread = 0
+    while nread < nbytes:
+        chunk = sock.recv(min(nbytes - nread, 4096))
+        if not chunk:
+            break
+        nread += len(chunk)
+        res.append(chunk)
+    return b"".join(res)
+
+
+def _recv_msg(sock):
+    """Receive a message, None when the peer closes."""
+    header = _recvall(sock, 4)
+    if len(header) != 4:
+        return None
+    size = struct.unpack("@i", header)[0]
+    data = _recvall(sock, size)
+    if len(data) != size:
+        return None
+    return json.loads(py_str(data))
+
+
+def _peer_closed(conn):
+    """Whether the peer closed conn, the client sends nothing while it waits."""
+    try:
+        if not select.select([conn], [], [], 0)[0]:
+            return False
+        return not conn.recv(1, socket.MSG_PEEK)
+    except (socket.error, ValueError):
+        return True
+
+
+def _connect_tracker(addr):
+    sock = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+    sock.connect(addr)
+    sock.sendall(struct.pack("@i", RPC_TRACKER_MAGIC))
+    magic = _recvall(sock, 4)
+    if len(magic) != 4 or struct.unpack("@i", magic)[0] != RPC_TRACKER_MAGIC:
+        raise RuntimeError("%s is not RPC Tracker" % str(addr))
+    return sock
+
+
+class _ServerInfo(object):
+    """A registered server."""
+    def __init__(self, conn, key, addr):
+        self.conn = conn
+        self.key = key
+        self.addr = addr
+        self.match_key = None
+        self.busy_since = None
+        self.busy_time = 0.0
+        self.start_time = time.time()
+
+    def utilization(self, now):
+        busy = self.busy_time
+        if self.busy_since is not None:
+            busy += now - self.busy_since
+        return busy, now - self.start_time
+
+
+class _Request(object):
+    """A client waiting for a server."""
+    def __init__(self, conn):
+        self.conn = conn
+        self.result = None
+        self.dropped = False
+        self.start_time = time.time()
+
+
+class _KeyQueue(object):
+    """The servers and waiting requests of a key."""
+    def __init__(self):
+        self.servers = []
+        self.free = []
+        self.pending = []
+        self.served = 0
+        self.wait_time = 0.0
+
+
+class _TrackerState(object):
+    """Scheduling state of the tracker, shared by the connection threads."""
+    def __init__(self):
+        self.cond = threading.Condition()
+        self.queues = {}
+        self.seq = 0
+
+    def queue(self, key):
+        if key not in self.queues:
+            self.queues[key] = _KeyQueue()
+        return self.queues[key]
+
+    def put(self, server, match_key):
+        """A server is free, with the match key of its next client."""
+        with self.cond:
+            q = self.queue(server.key)
+            if server not in q.servers:
+                q.servers.append(server)
+            if server.busy_since is not None:
+                server.busy_time += time.time() - server.busy_since
+                server.busy_since = None
+            if server in q.free:
+                q.free.remove(server)
+            server.match_key = match_key
+            q.free.append(server)
+        self.dispatch(q)
+
+    def remove(self, server):
+        with self.cond:
+            q = self.queue(server.key)
+            if server in q.servers:
+                q.servers.remove(server)
+            if server in q.free:
+                q.free.remove(server)
+
+    def _match(self, q):
+        """Pair the free servers with the waiting requests, highest priority
+        first, dropping the requests whose client has closed."""
+        pairs = []
+        while q.free and q.pending:
+            entry = heapq.heappop(q.pending)
+            if _peer_closed(entry[2].conn):
+                entry[2].dropped = True
+                continue
+            pairs.append((q.free.pop(0), entry))
+        if pairs:
+            self.cond.notify_all()
+        return pairs
+
+    def dispatch(self, q):
+        """Hand the free servers to the waiting requests.
+
+        Called without the lock, the ASSIGNED notices are sent outside of it.
+        """
+        with self.cond:
+            pairs = self._match(q)
+        while pairs:
+            sent = []
+            for server, entry in pairs:
+                try:
+                    _send_msg(server.conn, [TrackerCode.ASSIGNED, server.match_key])
+                    sent.append(True)
+                except socket.error:
+                    # the server is gone, its thread removes it.
+                    sent.append(False)
+            with self.cond:
+                for (server, entry), ok in zip(pairs, sent):
+                    req = entry[2]
+                    if not ok:
+                        heapq.heappush(q.pending, entry)
+                        continue
+                    server.busy_since = time.time()
+                    q.served += 1
+                    q.wait_time += server.busy_since - req.start_time
+                    req.result = [server.addr[0], server.addr[1], server.match_key]
+                self.cond.notify_all()
+                pairs = self._match(q)
+
+    def request(self, key, priority, timeout, conn):
+        """Wait for a server of key, return its address and match key.
+
+        Return None on timeout, or once the client closes conn.
+        """
+        req = _Request(conn)
+        with self.cond:
+            q = self.queue(key)
+            self.seq += 1
+            entry = (-priority, self.seq, req)
+            heapq.heappush(q.pending, entry)
+        self.dispatch(q)
+        deadline = None if timeout is None else time.time() + timeout
+        with self.cond:
+            while req.result is None:
+                if req.dropped:
+                    return None
+                remain = None if deadline is None else deadline - time.time()
+                # a request being handed a server waits for the outcome.
+                if entry in q.pending:
+                    if (remain is not None and remain <= 0) or _peer_closed(conn):
+                        q.pending.remove(entry)
+                        heapq.heapify(q.pending)
+                        return None
+                    wait = CLIENT_POLL_INTERVAL if remain is None else min(
+                        remain, CLIENT_POLL_INTERVAL)
+                else:
+                    wait = CLIENT_POLL_INTERVAL
+                self.cond.wait(wait)
+            return req.result
+
+    def summary(self):
+        with self.cond:
+            now = time.time()
+            info = {}
+            for key, q in self.queues.items():
+                busy, total = 0.0, 0.0
+                for server in q.servers:
+                    b, t = server.utilization(now)
+                    busy += b
+                    total += t
+                info[key] = {
+                    "free": len(q.free),
+                    "busy": len(q.servers) - len(q.free),
+                    "pending": len(q.pending),
+                    "served": q.served,
+                    "mean_wait": q.wait_time / q.served if q.served else 0.0,
+                    "utilization": busy / total if total > 0 else 0.0}
+            return info
+
+
+def _handle_conn(state, conn, addr):
+    """Serve the messages of a server or client connection."""
+    server = None
+    try:
+        magic = _recvall(conn, 4)
+        if len(magic) != 4 or struct.unpack("@i", magic)[0] != RPC_TRACKER_MAGIC:
+            return
+        conn.sendall(struct.pack("@i", RPC_TRACKER_MAGIC))
+        while True:
+            msg = _recv_msg(conn)
+            if msg is None:
+                break
+            code = msg[0]
+            if code == TrackerCode.PUT:
+                _, key, port, match_key = msg
+                if server is None:
+                    server = _ServerInfo(conn, key, (addr[0], port))
+                    logging.info("RPCTracker: server %s:%d registers key %s",
+                                 addr[0], port, key)
+                # replied before the server is free, the tracker
+                # only sends it ASSIGNED notices from then on.
+                _send_msg(conn, [TrackerCode.SUCCESS])
+                state.put(server, match_key)
+            elif code == TrackerCode.REQUEST:
+                _, key, priority, timeout = msg
+                result = state.request(key, priority, None if timeout < 0 else timeout, conn)
+                if result is None:
+                    _send_msg(conn, [TrackerCode.FAIL,
+                                     "no free server of key %s within %g seconds" %
+                                     (key, timeout)])
+                else:
+                    _send_msg(conn, [TrackerCode.SUCCESS] + result)
+            elif code == TrackerCode.SUMMARY:
+                _send_msg(conn, [TrackerCode.SUCCESS, state.summary()])
+            else:
+                _send_msg(conn, [TrackerCode.FAIL, "unknown tracker code %d" % code])
+    except (socket.error, ValueError) as err:
+        logging.info("RPCTracker: connection from %s ends with %s", addr, err)
+    finally:
+        if server is not None:
+            logging.info("RPCTracker: server %s:%d of key %s leaves",
+                         server.addr[0], server.addr[1], server.key)
+            state.remove(server)
+        conn.close()
+
+
+def _tracker_loop(sock):
+    """Accept the connections of servers and clients, one thread each."""
+    state = _TrackerState()
+    while True:
+        conn, addr = sock.accept()
+        thread = threading.Thread(target=_handle_conn, args=(state, conn, addr))
+        thread.daemon = True
+        thread.start()
+
+
+def _tracker_listen_loop(sock, port, tracker_addr, key, use_shm=False, cache_dir=None):
+    """Listening loop of a server that registers at a tracker.
+
+    The server serves one session at a time, and only to the client
+    the tracker handed its match key to. A client may limit the
+    session by appending " -timeout=<seconds>" to the key.
+    """
+    tracker = _connect_tracker(tracker_addr)
+    while True:
+        match_key = "%s:%x" % (key, random.getrandbits(64))
+        _send_msg(tracker, [TrackerCode.PUT, key, port, match_key])
+        # skip the notices of the previous match keys.
+        msg = _recv_msg(tracker)
+        while msg is not None and msg[0] == TrackerCode.ASSIGNED:
+            msg = _recv_msg(tracker)
+        if msg is None:
+            logging.info("RPCServer: tracker %s closed", str(tracker_addr))
+            return
+        deadline = None
+        while True:
+            wait = None if deadline is None else max(deadline - time.time(), 0)
+            readable = select.select([sock, tracker], [], [], wait)[0]
+            if not readable:
+                logging.info("RPCServer: client of %s did not come", match_key)
+                break
+            if tracker in readable:
+                msg = _recv_msg(tracker)
+                if msg is None:
+                    logging.info("RPCServer: tracker %s closed", str(tracker_addr))
+                    return
+                if msg[0] == TrackerCode.ASSIGNED and msg[1] == match_key:
+                    deadline = time.time() + CLIENT_CONNECT_TIMEOUT
+                continue
+            conn, addr = sock.accept()
+            handshake = _recv_handshake(conn)
+            if handshake is None:
+                conn.close()
+                continue
+            flags, client_key, shm_name = handshake
+            args = client_key.split(" ")
+            if args[0] != "client:" + match_key:
+                conn.sendall(struct.pack("@i", RPC_MAGIC + 2))
+                conn.close()
+                continue
+            if shm_name and not use_shm:
+                conn.sendall(struct.pack("@i", RPC_MAGIC + 3))
+                conn.close()
+                continue
+            conn.sendall(struct.pack("@i", RPC_MAGIC))
+            timeout = None
+            for arg in args[1:]:
+                if arg.startswith("-timeout="):
+                    timeout = float(arg[len("-timeout="):])
+            logging.info("RPCServer: session %s from %s", match_key, addr)
+            process = multiprocessing.Process(
+                target=_serve_loop,
+                args=(conn, addr, shm_name, bool(flags & RPC_MUX_FLAG), cache_dir))
+            process.deamon = True
+            process.start()
+            conn.close()
+            process.join(timeout)
+            if process.is_alive():
+                logging.info("RPCServer: session %s timed out", match_key)
+                process.terminate()
+                process.join()
+            break
+
+
+class Tracker(object):
+    """Start RPC tracker on a seperate process.
+
+    Parameters
+    ----------
+    host : str
+        The host url of the tracker.
+
+    port : int
+        The port to be bind to
+
+    port_end : int, optional
+        The end port to search
+    """
+    def __init__(self,
+                 host,
+                 port=9190,
+                 port_end=9199):
+        sock = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+        self.port = None
+        for my_port in range(port, port_end):
+            try:
+                sock.bind((host, my_port))
+                self.port = my_port
+                break
+            except socket.error as sock_err:
+                if sock_err.errno in [98, 48]:
+                    continue
+                else:
+                    raise sock_err
+        if not self.port:
+            raise ValueError("cannot bind to any port in [%d, %d)" % (port, port_end))
+        logging.info("RPCTracker: bind to %s:%d", host, self.port)
+        sock.listen(16)
+        self.proc = multiprocessing.Process(target=_tracker_loop, args=(sock,))
+        self.proc.daemon = True
+        self.proc.start()
+        self.host = host
+
+    def terminate(self):
+        """Terminate the tracker process"""
+        if self.proc:
+            self.proc.terminate()
+            self.proc = None
+
+    def __del__(self):
+        self.terminate()
+
+
+class TrackerSession(object):
+    """Client connection to a tracker.
+
+    Do not directly create the object, call connect_tracker
+    """
+    def __init__(self, addr):
+        self._addr = addr
+        self._sock = _connect_tracker(addr)
+
+    def __del__(self):
+        self.close()
+
+    def close(self):
+        """Close the connection to the tracker."""
+        if self._sock:
+            self._sock.close()
+            self._sock = None
+
+    def _call(self, msg):
+        _send_msg(self._sock, msg)
+        res = _recv_msg(self._sock)
+        if res is None:
+            raise RuntimeError("RPC Tracker %s closed" % str(self._addr))
+        if res[0] != TrackerCode.SUCCESS:
+            raise RuntimeError(res[1])
+        return res[1:]
+
+    def request(self, key, priority=0, timeout=None, session_timeout=None, **kwargs):
+        """Wait for a free server of key and connect to it.
+
+        Parameters
+        ----------
+        key : str
+            The key of the servers.
+
+        priority : int, optional
+            Requests of higher priority get a server first, requests of
+            the same priority in their order of arrival.
+
+        timeout : float, optional
+            Seconds to wait for a free server, forever by default.
+
+        session_timeout : float, optional
+            Seconds after which the server ends the session, so that a
+            stuck job does not hold the device forever.
+
+        kwargs : dict
+            Additional arguments of rpc.connect, e.g. transport.
+
+        Returns
+        -------
+        sess : RPCSession
+            The session, the server is handed out again once it closes.
+        """
+        host, port, match_key = self._call(
+            [TrackerCode.REQUEST, key, priority, -1 if timeout is None else timeout])
+        if session_timeout:
+            match_key += " -timeout=%g" % session_timeout
+        return rpc.connect(host, port, match_key, **kwargs)
+
+    def summary(self):
+        """Get the state of the queues.
+
+        Returns
+        -------
+        summary : dict of str to dict
+            For each key the number of free and busy servers, the number
+            of pending requests, the number of sessions served, their mean
+            wait in seconds and the fraction of time the servers were busy.
+        """
+        return self._call([TrackerCode.SUMMARY])[0]
+
+
+def connect_tracker(url, port):
+    """Connect to RPC tracker
+
+    Parameters
+    ----------
+    url : str
+        The url of the host
+
+    port : int
+        The port to connect to
+
+    Returns
+    -------
+    sess : TrackerSession
+        The connected tracker session.
+    """
+    return TrackerSession((url, port))
@@ -24,6 +24,15 @@ def main():
     parser.add_argument('--exclusive', action='store_true',
                         help="If this is enabled, the server will kill old connection"
                              "when new connection comes")
+    parser.add_argument('--use-shm', action='store_true',
+                        help="Whether clients on the same host can connect "
+                             "through shared memory")
+    parser.add_argument('--tracker', type=str, default="",
+                        help="The address host:port of an RPC tracker to register at")
+    parser.add_argument('--key', type=str, default="",
+                        help="The key of the server at the tracker")
+    parser.add_argument('--cache-dir', type=str, default=None,
+                        help="The directory of the module cache, kept across restarts")
     args = parser.parse_args()
 
     logging.basicConfig(level=logging.INFO)
@@ -38,7 +47,13 @@ def main():
         libs.append(ctypes.CDLL(file_name, ctypes.RTLD_GLOBAL))
         logging.info("Load additional library %s", file_name)
 
-    server = rpc.Server(args.host, args.port, args.port_end, exclusive=args.exclusive)
+    tracker_addr = None
+    if args.tracker:
+        url, port = args.tracker.rsplit(":", 1)
+        tracker_addr = (url, int(port))
+    server = rpc.Server(args.host, args.port, args.port_end, exclusive=args.exclusive,
+                        key=args.key, use_shm=args.use_shm, tracker_addr=tracker_addr,
+                        cache_dir=args.cache_dir)
     server.libs += libs
     server.proc.join()
 
@@ -8,7 +8,42 @@ from ._ffi.function import ModuleBase, _set_class_module
 from ._ffi.function import _init_api
 from .contrib import cc as _cc, tar as _tar, util as _util
 
-ProfileResult = namedtuple("ProfileResult", ["mean", "results"])
+ProfileResult = namedtuple("ProfileResult", [
+    "mean", "results", "min", "median", "p90", "p99", "std", "robust_mean", "num_outliers",
+    "counters"])
+
+# Must match kTimeEvalCountersMagic in src/runtime/rpc/rpc_session.h
+_TIME_EVAL_COUNTERS_MAGIC = 0x7FF8C0DE0000C001
+
+
+def _percentile(ordered, q):
+    """Linearly interpolated q-th percentile of sorted values."""
+    pos = (len(ordered) - 1) * q / 100.0
+    low = int(pos)
+    high = min(low + 1, len(ordered) - 1)
+    return ordered[low] + (ordered[high] - ordered[low]) * (pos - low)
+
+
+def _profile_result(results, counters=None):
+    """Summarize the seconds per call of each repeat.
+
+    Results further than 3 scaled median absolute deviations above or
+    below the median, e.g. runs hit by an interrupt, are left out of
+    robust_mean.
+    """
+    results = tuple(results)
+    counters = counters or {}
+    ordered = sorted(results)
+    num = len(results)
+    mean = sum(results) / float(num)
+    std = (sum((x - mean) ** 2 for x in results) / max(num - 1, 1)) ** 0.5
+    median = _percentile(ordered, 50)
+    mad = 1.4826 * _percentile(sorted(abs(x - median) for x in results), 50)
+    inliers = [x for x in results if abs(x - median) <= 3 * mad] if mad > 0 else results
+    return ProfileResult(mean=mean, results=results, min=ordered[0], median=median,
+                         p90=_percentile(ordered, 90), p99=_percentile(ordered, 99),
+                         std=std, robust_mean=sum(inliers) / float(len(inliers)),
+                         num_outliers=num - len(inliers), counters=counters)
 
 
 class Module(ModuleBase):
@@ -117,7 +152,8 @@ class Module(ModuleBase):
                 fcompile = _cc.create_shared
         fcompile(file_name, files, **kwargs)
 
-    def time_evaluator(self, func_name, ctx, number, repeat=1):
+    def time_evaluator(self, func_name, ctx, number, repeat=1,
+                       max_repeat=0, rel_ci=0.02, flush_cache_bytes=0, counters=None):
         """Get an evaluator that measures time cost of running function.
 
         Parameters
@@ -135,6 +171,28 @@ class Module(ModuleBase):
             Number of times to run the timer measurement
             If repeat equals 3, then we will get 3 numbers in the ProfileResult.
 
+        max_repeat: int, optional
+            When larger than repeat, the measurement goes on after repeat
+            runs until the 95% confidence interval of the mean is within
+            rel_ci of the mean, or max_repeat runs are done.
+
+        rel_ci: float, optional
+            The target half width of the confidence interval relative
+            to the mean, only used with max_repeat.
+
+        flush_cache_bytes: int, optional
+            When positive, this many bytes of memory are written before
+            each run to evict the CPU caches, so the first of the number
+            calls of a run starts cold.
+
+        counters: list of str, optional
+            Hardware counters read with perf_event_open around each run
+            on Linux: "cycles", "instructions", "cache-references",
+            "cache-misses", "branches", "branch-misses", "task-clock"
+            or "page-faults". A counter the system does not allow is
+            reported as nan. The evaluator raises RuntimeError when the
+            server does not report the requested counters.
+
         Note
         ----
         The function will be invoked  repeat * number + 1 times,
@@ -143,21 +201,38 @@ class Module(ModuleBase):
         Returns
         -------
         ftimer : Function
-            The function that takes same argument as func
-            and return a float representing seconds per function call.
+            The function that takes same argument as func and returns
+            a ProfileResult of the seconds per function call, with the
+            result of each run, its percentiles and the mean without
+            outliers. Its counters map each counter to the count per
+            call of each run.
         """
+        counters = list(counters or [])
         try:
             feval = _RPCTimeEvaluator(
-                self, func_name, ctx.device_type, ctx.device_id, number, repeat)
+                self, func_name, ctx.device_type, ctx.device_id, number, repeat,
+                max_repeat, float(rel_ci), flush_cache_bytes, ",".join(counters))
 
             def evaluator(*args):
                 """Internal wrapped evaluator."""
-                # Wrap feval so we can add more stats in future.
                 blob = feval(*args)
-                fmt = "@" + ("d" * repeat)
-                results = struct.unpack(fmt, blob)
-                mean = sum(results) / float(repeat)
-                return ProfileResult(mean=mean, results=results)
+                if counters:
+                    # the server states the number of counters it reports,
+                    # servers without counter support send the times only.
+                    header = struct.unpack("@QQ", blob[:16]) if len(blob) >= 16 else None
+                    if header is None or header[0] != _TIME_EVAL_COUNTERS_MAGIC:
+                        raise RuntimeError("The server does not report counters")
+                    if header[1] != len(counters):
+                        raise RuntimeError("The server reports %d counters, %d were requested"
+                                           % (header[1], len(counters)))
+                    blob = blob[16:]
+                # adaptive repeats decide the count, each run records
+                # its time and then its counters.
+                values = struct.unpack("@" + ("d" * (len(blob) // 8)), blob)
+                stride = len(counters) + 1
+                return _profile_result(
+                    values[::stride],
+                    {name: values[i + 1::stride] for i, name in enumerate(counters)})
 
             return evaluator
         except NameError:
@@ -44,6 +44,13 @@ class LLVMModuleNode final : public runtime::ModuleNode {
         });
     }
     if (ee_ == nullptr) LazyInitJIT();
+    if (name == runtime::symbol::tvm_get_backend_func_addr) {
+      return PackedFunc([sptr_to_self, this](TVMArgs args, TVMRetValue* rv) {
+          std::lock_guard<std::mutex> lock(mutex_);
+          *rv = reinterpret_cast<void*>(
+              GetFunctionAddr(args[0].operator std::string()));
+        });
+    }
     std::lock_guard<std::mutex> lock(mutex_);
     const std::string& fname = (name == runtime::symbol::tvm_module_main ?
                                 entry_func_ : name);
@@ -79,9 +79,11 @@ class RingBuffer {
     CHECK_NE(size, 0U);
     size_t ncopy = std::min(size, ring_.size() - head_ptr_);
     size_t nsend = fsend(&ring_[0] + head_ptr_, ncopy);
+    head_ptr_ = (head_ptr_ + nsend) % ring_.size();
     bytes_available_ -= nsend;
     if (ncopy == nsend && ncopy < size) {
       size_t nsend2 = fsend(&ring_[0], size - ncopy);
+      head_ptr_ = nsend2;
       bytes_available_ -= nsend2;
       nsend += nsend2;
     }
@@ -21,12 +21,15 @@ using ssize_t = int;
 #include <unistd.h>
 #include <arpa/inet.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <sys/socket.h>
 #include <sys/ioctl.h>
+#include <sys/uio.h>
 #endif
 #include <dmlc/logging.h>
 #include <string>
 #include <cstring>
+#include <vector>
 
 
 namespace tvm {
@@ -289,6 +292,17 @@ class TCPSocket : public Socket {
       Socket::Error("SetKeepAlive");
     }
   }
+  /*!
+   * \brief enable/disable the Nagle algorithm
+   * \param nodelay whether to send small segments without delay
+   */
+  void SetNoDelay(bool nodelay) {
+    int opt = static_cast<int>(nodelay);
+    if (setsockopt(sockfd, IPPROTO_TCP, TCP_NODELAY,
+                   reinterpret_cast<char*>(&opt), sizeof(opt)) < 0) {
+      Socket::Error("SetNoDelay");
+    }
+  }
   /*!
    * \brief create the socket, call this before using socket
    * \param af domain
@@ -364,6 +378,36 @@ class TCPSocket : public Socket {
     char *buf = reinterpret_cast<char*>(buf_);
     return recv(sockfd, buf, static_cast<sock_size_t>(len), flags);
   }
+  /*!
+   * \brief receive data into several buffers, filled in order
+   * \param bufs the pointers to the buffers
+   * \param lens the sizes of the buffers
+   * \param num the number of buffers
+   * \return size of data actually received
+   *         return -1 if error occurs
+   */
+  ssize_t RecvV(void* const* bufs, const size_t* lens, int num) {
+#ifdef _WIN32
+    std::vector<WSABUF> iov(num);
+    for (int i = 0; i < num; ++i) {
+      iov[i].buf = reinterpret_cast<char*>(bufs[i]);
+      iov[i].len = static_cast<ULONG>(lens[i]);
+    }
+    DWORD nrecv = 0, flags = 0;
+    if (WSARecv(sockfd, iov.data(), static_cast<DWORD>(num),
+                &nrecv, &flags, NULL, NULL) == SOCKET_ERROR) {
+      return -1;
+    }
+    return static_cast<ssize_t>(nrecv);
+#else
+    std::vector<struct iovec> iov(num);
+    for (int i = 0; i < num; ++i) {
+      iov[i].iov_base = bufs[i];
+      iov[i].iov_len = lens[i];
+    }
+    return readv(sockfd, iov.data(), num);
+#endif
+  }
   /*!
    * \brief peform block write that will attempt to send all data out
    *    can still return smaller than request when error occurs
@@ -11,10 +11,13 @@
 #include <tvm/runtime/registry.h>
 #include <tvm/runtime/device_api.h>
 #include <array>
+#include <atomic>
 #include <algorithm>
 #include <string>
 #include <cstdlib>
+#include <unordered_map>
 #include "./runtime_base.h"
+#include "./workspace_pool.h"
 
 namespace tvm {
 namespace runtime {
@@ -168,6 +171,50 @@ inline size_t GetDataAlignment(TVMArray* arr) {
   return align;
 }
 
+/*! \brief Workspace events recorded on a thread. */
+struct WorkspaceTrace {
+  bool enabled{false};
+  std::vector<WorkspaceEvent> events;
+  // index of the allocation event of each live pointer.
+  std::unordered_map<void*, int64_t> live;
+};
+
+typedef dmlc::ThreadLocalStore<WorkspaceTrace> WorkspaceTraceStore;
+
+/*!
+ * \brief Number of threads with an active trace, lets the backend
+ *  workspace calls skip the thread local lookup when nobody traces.
+ */
+static std::atomic<int> num_workspace_traces{0};
+
+inline WorkspaceTrace* ActiveWorkspaceTrace() {
+  if (num_workspace_traces.load(std::memory_order_relaxed) == 0) return nullptr;
+  WorkspaceTrace* trace = WorkspaceTraceStore::Get();
+  return trace->enabled ? trace : nullptr;
+}
+
+void StartWorkspaceTrace() {
+  WorkspaceTrace* trace = WorkspaceTraceStore::Get();
+  trace->events.clear();
+  trace->live.clear();
+  if (!trace->enabled) {
+    trace->enabled = true;
+    num_workspace_traces.fetch_add(1);
+  }
+}
+
+std::vector<WorkspaceEvent> StopWorkspaceTrace() {
+  WorkspaceTrace* trace = WorkspaceTraceStore::Get();
+  if (trace->enabled) {
+    trace->enabled = false;
+    num_workspace_traces.fetch_sub(1);
+  }
+  trace->live.clear();
+  std::vector<WorkspaceEvent> ret;
+  ret.swap(trace->events);
+  return ret;
+}
+
 }  // namespace runtime
 }  // namespace tvm
 
@@ -250,9 +297,15 @@ void* TVMBackendAllocWorkspace(int device_type,
   type_hint.bits = static_cast<decltype(type_hint.bits)>(dtype_bits_hint);
   type_hint.lanes = 1;
 
-  return DeviceAPIManager::Get(ctx)->AllocWorkspace(ctx,
-                                                    static_cast<size_t>(size),
-                                                    type_hint);
+  void* ptr = DeviceAPIManager::Get(ctx)->AllocWorkspace(ctx,
+                                                         static_cast<size_t>(size),
+                                                         type_hint);
+  WorkspaceTrace* trace = ActiveWorkspaceTrace();
+  if (trace != nullptr) {
+    trace->live[ptr] = static_cast<int64_t>(trace->events.size());
+    trace->events.push_back(WorkspaceEvent{ctx, size, type_hint, -1});
+  }
+  return ptr;
 }
 
 int TVMBackendFreeWorkspace(int device_type,
@@ -261,6 +314,14 @@ int TVMBackendFreeWorkspace(int device_type,
   TVMContext ctx;
   ctx.device_type = static_cast<DLDeviceType>(device_type);
   ctx.device_id = device_id;
+  WorkspaceTrace* trace = ActiveWorkspaceTrace();
+  if (trace != nullptr) {
+    auto it = trace->live.find(ptr);
+    if (it != trace->live.end()) {
+      trace->events.push_back(WorkspaceEvent{ctx, 0, TVMType(), it->second});
+      trace->live.erase(it);
+    }
+  }
   DeviceAPIManager::Get(ctx)->FreeWorkspace(ctx, ptr);
   return 0;
 }
@@ -33,6 +33,12 @@ class DSOModuleNode final : public ModuleNode {
       const std::string& name,
       const std::shared_ptr<ModuleNode>& sptr_to_self) final {
     BackendPackedCFunc faddr;
+    if (name == runtime::symbol::tvm_get_backend_func_addr) {
+      return PackedFunc([sptr_to_self, this](TVMArgs args, TVMRetValue* rv) {
+          void* addr = GetSymbol(args[0].operator std::string().c_str());
+          *rv = addr;
+        });
+    }
     if (name == runtime::symbol::tvm_module_main) {
       const char* entry_name = reinterpret_cast<const char*>(
           GetSymbol(runtime::symbol::tvm_module_main));
@@ -3,11 +3,24 @@
  * \file graph_runtime.cc
  */
 #include <tvm/runtime/packed_func.h>
+#include <tvm/runtime/c_backend_api.h>
 #include <tvm/runtime/registry.h>
+#include <tvm/runtime/device_api.h>
 #include <dmlc/memory_io.h>
 #include <dmlc/json.h>
+#include <chrono>
+#include <map>
+#include <cstring>
+#include <limits>
 #include <numeric>
+#include <sstream>
+#include <tuple>
+#include <utility>
 #include "./graph_runtime.h"
+#include "./memory_planner.h"
+#include "./shared_arena.h"
+#include "../module_util.h"
+#include "../workspace_pool.h"
 
 namespace tvm {
 namespace runtime {
@@ -32,6 +45,7 @@ class GraphRuntime : public ModuleNode {
     for (DLTensor* t : storage_pool_) {
       TVM_CCALL(TVMArrayFree(t));
     }
+    if (arena_ != nullptr) arena_->Forget(this);
   }
   /*!
    * \brief Get member function to front-end
@@ -50,32 +64,89 @@ class GraphRuntime : public ModuleNode {
     return "GraphRuntime";
   }
   void Run() {
+    ArenaScope scope(this);
+    ++run_epoch_;
+    if (num_output_callbacks_ != 0 || gate_open_.size() != 0) {
+      this->RunEachNode();
+      return;
+    }
+    if (run_plan_.size() != 0) {
+      this->RunPlan();
+      return;
+    }
     // setup the array and requirements.
-    for (size_t i = 0; i < op_execs_.size(); ++i) {
-      if (op_execs_[i]) op_execs_[i]();
+    for (uint32_t nid : exec_order_) {
+      if (op_execs_[nid]) op_execs_[nid]();
     }
   }
   /*!
    * \brief Initialize the graph executor with graph and context.
-   * \param graph_json The execution graph.
+   * \param graph_json The execution graph, in json or binary format.
    * \param module The module containing the compiled functions.
-   * \param ctx The context where the graph should sit on
+   * \param ctxs The contexts where the graph should sit on, the
+   *  device_index attribute of each node indexes into this list.
    */
   void Init(const std::string& graph_json,
             tvm::runtime::Module module,
-            TVMContext ctx) {
-#ifndef _LIBCPP_SGX_NO_IOSTREAMS
-    std::istringstream is(graph_json);
-#else
-    std::string is = graph_json;
-#endif
-    dmlc::JSONReader reader(&is);
-    this->Load(&reader);
+            const std::vector<TVMContext>& ctxs) {
+    CHECK_NE(ctxs.size(), 0U);
+    this->LoadGraph(graph_json);
     module_ = module;
-    ctx_ = ctx;
+    ctx_ = ctxs[0];
+    ctxs_ = ctxs;
     this->SetupStorage();
     this->SetupOpExecs();
+    this->SetupGates();
+  }
+  /*!
+   * \brief Initialize the graph executor from a deploy artifact.
+   *
+   *  The artifact holds the graph in binary format with the shape ops
+   *  already fused, the execution order, the memory plan and the params,
+   *  so the executor is set up without parsing or planning.
+   *
+   * \param strm The stream of the artifact written by SaveDeploy.
+   * \param module The module containing the compiled functions.
+   * \param ctxs The contexts where the graph should sit on.
+   */
+  void InitDeploy(dmlc::Stream* strm,
+                  tvm::runtime::Module module,
+                  const std::vector<TVMContext>& ctxs);
+  /*!
+   * \brief Save the initialized executor as a deploy artifact.
+   *  Plans the memory first when it can be planned and is not yet.
+   * \param strm The output stream.
+   */
+  void SaveDeploy(dmlc::Stream* strm);
+  /*!
+   * \brief Load the graph structure without setting up the executor.
+   *  The format is detected from the leading magic number.
+   * \param graph The graph in json or binary format.
+   */
+  void LoadGraph(const std::string& graph) {
+    uint64_t header = 0;
+    if (graph.length() >= sizeof(header)) {
+      std::memcpy(&header, graph.data(), sizeof(header));
+    }
+    if (header == kTVMGraphBinaryMagic) {
+      dmlc::MemoryFixedSizeStream strm(
+          const_cast<char*>(graph.data()), graph.length());
+      this->LoadBinary(&strm);
+    } else {
+#ifndef _LIBCPP_SGX_NO_IOSTREAMS
+      std::istringstream is(graph);
+#else
+      std::string is = graph;
+#endif
+      dmlc::JSONReader reader(&is);
+      this->Load(&reader);
+    }
   }
+  /*!
+   * \brief Save the loaded graph in binary format.
+   * \param strm The output stream.
+   */
+  void SaveBinary(dmlc::Stream* strm) const;
   /*!
    * \brief Get the input index given the name of input.
    * \param name The name of the input.
@@ -111,6 +182,141 @@ class GraphRuntime : public ModuleNode {
     uint32_t eid = this->entry_id(outputs_[index]);
     TVM_CCALL(TVMArrayCopyFromTo(&data_entry_[eid], data_out, nullptr));
   }
+  /*!
+   * \brief Register a function called as soon as an output is computed.
+   *
+   *  The function receives the output index and a DLTensor view of the
+   *  output, which is only valid during the call. It runs on the thread
+   *  of Run right after the producing node, so heavy work should be
+   *  handed off to let it overlap with the rest of the graph.
+   *
+   * \param index The output index.
+   * \param callback The function, nullptr to remove it.
+   */
+  void SetOutputCallback(int index, PackedFunc callback);
+  /*!
+   * \brief Whether an output was computed by the last run.
+   *  Outputs behind a closed gate keep stale content.
+   * \param index The output index.
+   */
+  bool OutputValid(int index) const;
+  /*!
+   * \brief Set the batch size used by the next runs.
+   *
+   *  Only valid for graphs whose shapes carry a symbolic leading
+   *  batch dimension. The storage is planned for max_batch_size,
+   *  smaller batches run on the same buffers with rewritten shapes.
+   *
+   * \param batch_size The new batch size.
+   */
+  void SetBatchSize(int64_t batch_size);
+  /*!
+   * \brief Profile the execution of each node.
+   *
+   *  Runs the graph warmup times without measurement, then number
+   *  times while timing every operator separately. The normal Run
+   *  path is not affected.
+   *
+   * \param number Number of measured runs.
+   * \param warmup Number of runs before the measurement.
+   * \return JSON string that contains one record per operator node.
+   */
+  std::string Profile(int number, int warmup);
+  /*!
+   * \brief Lease the activations from a shared arena at each run.
+   *
+   *  Only the inputs and outputs keep their own memory, the other entries
+   *  are planned into one block leased from the arena while the graph runs.
+   *
+   * \param arena The SharedArena module, undefined to own the activations.
+   * \param pin Whether to keep the block between runs until it is evicted.
+   */
+  void UseSharedArena(Module arena, bool pin);
+  /*!
+   * \brief Replace the storage plan baked into the graph by a runtime plan.
+   *
+   *  Liveness is recomputed from the node list and all entries are packed
+   *  into one arena. Outputs of __nop nodes stay aliased with their inputs,
+   *  other outputs never share memory with the inputs of their node.
+   *  The content of the input entries is preserved.
+   *
+   * \param alignment The alignment of each entry in the arena.
+   * \return The number of bytes of the arena, without the activations
+   *  leased from a shared arena.
+   */
+  size_t PlanMemory(size_t alignment);
+  /*!
+   * \brief Turn the copy kernels of shape-only operators into __nop.
+   *
+   *  The operators are recognized by their function name, e.g.
+   *  fuse_reshape_1, and their outputs alias their inputs under the
+   *  runtime memory plan that replaces the storage plan of the graph.
+   *  Nothing changes when no operator can be rewritten. A compiled run
+   *  plan is dropped, compile it again afterwards.
+   *
+   * \param alignment The alignment of each entry in the arena.
+   * \return The number of rewritten nodes.
+   */
+  size_t FuseShapeOps(size_t alignment);
+  /*!
+   * \brief Choose an execution order that keeps the live activations small.
+   *
+   *  A greedy list scheduler picks among the ready nodes the one that
+   *  grows the live bytes the least, preferring consumers of the most
+   *  recently produced entries. The new order is kept only if it differs
+   *  and its estimated peak is not larger, then the memory is planned
+   *  for it. Otherwise the storage is left as is.
+   *
+   * \param alignment The alignment of each entry in the arena.
+   * \return JSON string with the estimated peak bytes and reuse distance
+   *  of the original and the chosen order.
+   */
+  std::string OptimizeOrder(size_t alignment);
+  /*!
+   * \brief Compile the executor into a flat run plan.
+   *
+   *  Each operator becomes a step that calls the backend function of
+   *  the module directly, with its argument values packed into one
+   *  contiguous block, skipping std::function and PackedFunc dispatch.
+   *  Operators whose address the module does not expose keep their
+   *  closure. The plan is checked against the closures on the current
+   *  inputs before Run starts to use it.
+   *
+   * \return JSON string with the number of steps, of direct calls,
+   *  and whether the plan is in use.
+   */
+  std::string CompileRunPlan();
+  /*!
+   * \return The number of bytes held by the storage pool.
+   */
+  size_t MemoryFootprint() const;
+  /*!
+   * \brief Warm up the graph so that the first real run is at steady state.
+   *
+   *  Writes every buffer of the storage pool to fault in its pages, then
+   *  runs the graph number times with every input filled by fill_value.
+   *  The backend workspace used by the first run becomes the warm state.
+   *  The content of the input entries is restored afterwards.
+   *
+   * \param number Number of synthetic runs.
+   * \param fill_value The value of every synthetic input element.
+   * \return JSON string with the time spent in each phase.
+   */
+  std::string Warmup(int number, double fill_value);
+  /*!
+   * \brief Serialize the warm state recorded by the last Warmup.
+   * \param strm The output stream.
+   */
+  void SaveWarmState(dmlc::Stream* strm) const;
+  /*!
+   * \brief Restore a saved warm state.
+   *
+   *  Replays the recorded workspace allocations so that the workspace
+   *  pool of the calling thread already holds pages of the right sizes.
+   *
+   * \param strm The input stream.
+   */
+  void LoadWarmState(dmlc::Stream* strm);
 #ifdef TVM_GRAPH_RUNTIME_DEBUG
   /*!
    * \brief Get the node index given the name of node.
@@ -140,10 +346,11 @@ class GraphRuntime : public ModuleNode {
   void DebugGetNodeOutput(int index, DLTensor* data_out) {
     CHECK_LT(static_cast<size_t>(index), nodes_.size());
     uint32_t eid = index;
+    ArenaScope scope(this);
 
-    for (size_t i = 0; i < op_execs_.size(); ++i) {
-      if (op_execs_[i]) op_execs_[i]();
-      if (static_cast<int>(i) == index) break;
+    for (uint32_t nid : exec_order_) {
+      if (op_execs_[nid]) op_execs_[nid]();
+      if (static_cast<int>(nid) == index) break;
     }
 
     TVM_CCALL(TVMArrayCopyFromTo(&data_entry_[eid], data_out, nullptr));
@@ -245,11 +452,40 @@ class GraphRuntime : public ModuleNode {
       }
       CHECK_EQ(bitmask, 1|2|4) << "invalid format";
     }
+    // Binary Saver
+    void Save(dmlc::Stream* strm) const {
+      strm->Write(op_type);
+      strm->Write(name);
+      strm->Write(param.func_name);
+      strm->Write(param.num_inputs);
+      strm->Write(param.num_outputs);
+      strm->Write(param.flatten_data);
+      strm->Write(inputs);
+      strm->Write(control_deps);
+    }
+    // Binary Loader
+    bool Load(dmlc::Stream* strm) {
+      if (!strm->Read(&op_type)) return false;
+      if (!strm->Read(&name)) return false;
+      if (!strm->Read(&param.func_name)) return false;
+      if (!strm->Read(&param.num_inputs)) return false;
+      if (!strm->Read(&param.num_outputs)) return false;
+      if (!strm->Read(&param.flatten_data)) return false;
+      if (!strm->Read(&inputs)) return false;
+      if (!strm->Read(&control_deps)) return false;
+      return true;
+    }
   };
   struct GraphAttr {
     size_t storage_num_not_alloctaed{0};
+    // maximum value of the symbolic batch dimension, 0 if not used.
+    int64_t max_batch_size{0};
+    // index of the context each node runs on, empty if all on the first.
+    std::vector<int> device_index;
+    // the node whose scalar output gates each node, -1 if not gated.
+    std::vector<int> gate;
     std::vector<int> storage_id;
-    std::vector<std::string> dltype;
+    std::vector<TVMType> dltype;
     std::vector<std::vector<int64_t> > shape;
     // The graph attribute fields.
     void Load(dmlc::JSONReader *reader) {
@@ -263,7 +499,12 @@ class GraphRuntime : public ModuleNode {
           reader->Read(&type);
           CHECK_EQ(type, "list_str");
           CHECK(reader->NextArrayItem());
-          reader->Read(&dltype);
+          std::vector<std::string> dltype_str;
+          reader->Read(&dltype_str);
+          dltype.clear();
+          for (const std::string& s_type : dltype_str) {
+            dltype.push_back(String2TVMType(s_type));
+          }
           CHECK(!reader->NextArrayItem());
           bitmask |= 1;
         } else if (key == "storage_id") {
@@ -284,6 +525,30 @@ class GraphRuntime : public ModuleNode {
           reader->Read(&shape);
           CHECK(!reader->NextArrayItem());
           bitmask |= 4;
+        } else if (key == "max_batch_size") {
+          reader->BeginArray();
+          CHECK(reader->NextArrayItem());
+          reader->Read(&type);
+          CHECK_EQ(type, "size_t");
+          CHECK(reader->NextArrayItem());
+          reader->Read(&max_batch_size);
+          CHECK(!reader->NextArrayItem());
+        } else if (key == "device_index") {
+          reader->BeginArray();
+          CHECK(reader->NextArrayItem());
+          reader->Read(&type);
+          CHECK_EQ(type, "list_int");
+          CHECK(reader->NextArrayItem());
+          reader->Read(&device_index);
+          CHECK(!reader->NextArrayItem());
+        } else if (key == "gate") {
+          reader->BeginArray();
+          CHECK(reader->NextArrayItem());
+          reader->Read(&type);
+          CHECK_EQ(type, "list_int");
+          CHECK(reader->NextArrayItem());
+          reader->Read(&gate);
+          CHECK(!reader->NextArrayItem());
         } else {
           reader->BeginArray();
           CHECK(reader->NextArrayItem());
@@ -304,6 +569,43 @@ class GraphRuntime : public ModuleNode {
       }
       CHECK_EQ(bitmask, 1|2|4) << "invalid format";
     }
+    // Binary Saver, shapes are stored as one flat array.
+    void Save(dmlc::Stream* strm) const {
+      std::vector<uint32_t> shape_ndim;
+      std::vector<int64_t> shape_data;
+      for (const auto& s : shape) {
+        shape_ndim.push_back(static_cast<uint32_t>(s.size()));
+        shape_data.insert(shape_data.end(), s.begin(), s.end());
+      }
+      strm->Write(storage_id);
+      strm->Write(dltype);
+      strm->Write(shape_ndim);
+      strm->Write(shape_data);
+      strm->Write(max_batch_size);
+      strm->Write(device_index);
+      strm->Write(gate);
+    }
+    // Binary Loader
+    bool Load(dmlc::Stream* strm) {
+      std::vector<uint32_t> shape_ndim;
+      std::vector<int64_t> shape_data;
+      if (!strm->Read(&storage_id)) return false;
+      if (!strm->Read(&dltype)) return false;
+      if (!strm->Read(&shape_ndim)) return false;
+      if (!strm->Read(&shape_data)) return false;
+      if (!strm->Read(&max_batch_size)) return false;
+      if (!strm->Read(&device_index)) return false;
+      if (!strm->Read(&gate)) return false;
+      shape.resize(shape_ndim.size());
+      size_t offset = 0;
+      for (size_t i = 0; i < shape_ndim.size(); ++i) {
+        if (offset + shape_ndim[i] > shape_data.size()) return false;
+        shape[i].assign(shape_data.begin() + offset,
+                        shape_data.begin() + offset + shape_ndim[i]);
+        offset += shape_ndim[i];
+      }
+      return offset == shape_data.size();
+    }
   };
   // The graph attribute fields.
   void Load(dmlc::JSONReader *reader) {
@@ -332,7 +634,32 @@ class GraphRuntime : public ModuleNode {
       }
       CHECK_EQ(bitmask, 1|2|4|8|16) << "invalid format";
   }
-  void LoadDLTensor(dmlc::Stream* strm, DLTensor* tensor);
+  // Load the graph from binary format.
+  void LoadBinary(dmlc::Stream* strm);
+  // Arguments of an operator closure.
+  struct OpArgs {
+    std::vector<DLTensor> args;
+    std::vector<TVMValue> arg_values;
+    std::vector<int> arg_tcodes;
+    std::vector<int64_t> shape_data;
+    // entry id of each argument.
+    std::vector<uint32_t> arg_eids;
+  };
+  void LoadDLTensor(dmlc::Stream* strm, DLTensor* tensor,
+                    const std::string& name = "");
+  /*!
+   * \brief Load a quantized DLTensor record after its header.
+   *  Float destinations are dequantized with the stored scales,
+   *  destinations of the stored dtype take the raw data and the scales
+   *  go to the float32 input named "<name>_scale".
+   * \param strm The input stream
+   * \param tensor The tensor to be loaded
+   * \param name The name of the param, used to find its scale input.
+   */
+  void LoadQuantizedDLTensor(dmlc::Stream* strm, DLTensor* tensor,
+                             const std::string& name);
+  /*! \brief Setup the shape, type and context of the data entries */
+  void SetupEntries();
   /*! \brief Setup the temporal storage */
   void SetupStorage();
   /*! \brief Setup the executors */
@@ -342,11 +669,12 @@ class GraphRuntime : public ModuleNode {
    * \param attrs The node attributes
    * \param args The arguments to the functor, including inputs and outputs.
    * \param num_inputs Number of inputs
-   * \return The created executor.
+   * \return The created executor and the arguments it captures.
    */
-  std::function<void()> CreateTVMOp(const TVMOpParam& attrs,
-                                    const std::vector<DLTensor>& args,
-                                    size_t num_inputs);
+  std::pair<std::function<void()>, std::shared_ptr<OpArgs> > CreateTVMOp(
+      const TVMOpParam& attrs,
+      const std::vector<DLTensor>& args,
+      size_t num_inputs);
   // Get node entry index.
   uint32_t entry_id(uint32_t nid, uint32_t index) const {
     return node_row_ptr_[nid] + index;
@@ -363,6 +691,157 @@ class GraphRuntime : public ModuleNode {
   uint32_t num_nodes() const {
     return static_cast<uint32_t>(nodes_.size());
   }
+  // A step of the compiled run plan.
+  struct RunStep {
+    // the backend function, nullptr to run the closure of nid.
+    BackendPackedCFunc faddr;
+    uint32_t nid;
+    // offset of the arguments in plan_values_ and plan_tcodes_.
+    size_t arg_offset;
+    int num_args;
+  };
+  // Build the run plan in the current execution order.
+  size_t BuildRunPlan(std::vector<RunStep>* plan);
+  // Call the output callbacks of the outputs ready after node nid.
+  void FireOutputCallbacks(uint32_t nid) {
+    for (uint32_t index : node_outputs_[nid]) {
+      if (output_callbacks_[index] == nullptr) continue;
+      uint32_t eid = this->entry_id(outputs_[index]);
+      const TVMContext& ctx = data_entry_[eid].ctx;
+      DeviceAPI::Get(ctx)->StreamSync(ctx, nullptr);
+      output_callbacks_[index](static_cast<int>(index), &data_entry_[eid]);
+    }
+  }
+  // Run one step of the compiled plan.
+  void RunStepOf(const RunStep& step) {
+    if (step.faddr != nullptr) {
+      int ret = (*step.faddr)(&plan_values_[step.arg_offset],
+                              &plan_tcodes_[step.arg_offset],
+                              step.num_args);
+      CHECK_EQ(ret, 0) << TVMGetLastError();
+    } else {
+      op_execs_[step.nid]();
+    }
+  }
+  // Run node by node, skipping the nodes behind closed gates
+  // and calling the output callbacks along the way. When time_sec is
+  // given, each executed node is synchronized and its time added to it,
+  // and num_runs counts the executions of each node.
+  void RunEachNode(std::vector<double>* time_sec = nullptr,
+                   std::vector<int>* num_runs = nullptr) {
+    ++run_epoch_;
+    for (uint32_t index : input_outputs_) {
+      if (output_callbacks_[index] == nullptr) continue;
+      uint32_t eid = this->entry_id(outputs_[index]);
+      output_callbacks_[index](static_cast<int>(index), &data_entry_[eid]);
+    }
+    bool use_plan = run_plan_.size() != 0;
+    size_t num_steps = use_plan ? run_plan_.size() : exec_order_.size();
+    for (size_t i = 0; i < num_steps; ++i) {
+      uint32_t nid = use_plan ? run_plan_[i].nid : exec_order_[i];
+      if (!op_execs_[nid]) continue;
+      if (gate_open_.size() != 0) {
+        int gate = attrs_.gate[nid];
+        if (gate >= 0 && !gate_open_[gate]) {
+          // a skipped gate closes the nodes behind it as well.
+          gate_open_[nid] = 0;
+          continue;
+        }
+      }
+      auto tbegin = std::chrono::high_resolution_clock::now();
+      if (use_plan) {
+        this->RunStepOf(run_plan_[i]);
+      } else {
+        op_execs_[nid]();
+      }
+      if (time_sec != nullptr) {
+        const TVMContext& ctx = ctxs_[node_device(nid)];
+        DeviceAPI::Get(ctx)->StreamSync(ctx, nullptr);
+        auto tend = std::chrono::high_resolution_clock::now();
+        (*time_sec)[nid] += std::chrono::duration_cast<std::chrono::duration<double> >(
+            tend - tbegin).count();
+        (*num_runs)[nid] += 1;
+      }
+      if (gate_open_.size() != 0 && is_gate_[nid]) {
+        gate_open_[nid] = this->ReadGate(nid);
+      }
+      if (num_output_callbacks_ != 0) {
+        this->FireOutputCallbacks(nid);
+      }
+    }
+  }
+  // Run the compiled plan.
+  void RunPlan() {
+    for (const RunStep& step : run_plan_) {
+      this->RunStepOf(step);
+    }
+  }
+  // Lease the shared activations and point the entries into them.
+  void LeaseArena() {
+    if (arena_ == nullptr || arena_bytes_ == 0 || arena_depth_++ != 0) return;
+    void* base = arena_->Lease(this, arena_bytes_);
+    if (base == arena_base_) return;
+    for (const auto& binding : arena_bindings_) {
+      binding.first->data = static_cast<char*>(base) + binding.second;
+    }
+    arena_base_ = base;
+  }
+  // Release the shared activations.
+  void ReleaseArena() {
+    if (arena_ == nullptr || arena_bytes_ == 0 || --arena_depth_ != 0) return;
+    arena_->Release(this, pin_arena_);
+  }
+  // Holds the shared activations in a scope, scopes can nest.
+  struct ArenaScope {
+    explicit ArenaScope(GraphRuntime* self) : self(self) {
+      self->LeaseArena();
+    }
+    ~ArenaScope() {
+      self->ReleaseArena();
+    }
+    GraphRuntime* self;
+  };
+  // Check the gate attribute and prepare the gate state.
+  void SetupGates();
+  // Read the scalar output of gate node nid, true when nonzero.
+  bool ReadGate(uint32_t nid);
+  // Whether the memory can be planned by the runtime, it needs a single
+  // device whose buffers support pointer arithmetic.
+  bool CanPlanMemory() const {
+    return ctxs_.size() == 1 &&
+        (ctx_.device_type == kDLCPU ||
+         ctx_.device_type == kDLGPU ||
+         ctx_.device_type == kDLROCM);
+  }
+  // Root entry of each entry, outputs of __nop share the root of the inputs.
+  std::vector<uint32_t> AliasGroups() const;
+  // Estimate the peak live bytes and the total producer to consumer
+  // distance in steps of running the nodes in order.
+  std::pair<size_t, size_t> EstimateOrder(
+      const std::vector<uint32_t>& order,
+      const std::vector<uint32_t>& group) const;
+  // Index of the context that node nid runs on.
+  int node_device(uint32_t nid) const {
+    return attrs_.device_index.size() == 0 ? 0 : attrs_.device_index[nid];
+  }
+  // A flat byte view of entry eid, at the maximum batch size.
+  DLTensor flat_entry(uint32_t eid, int64_t* shape) const {
+    DLTensor t = data_entry_[eid];
+    *shape = static_cast<int64_t>(data_entry_bytes_[eid]);
+    t.ndim = 1;
+    t.shape = shape;
+    t.strides = nullptr;
+    t.dtype = DLDataType{kDLUInt, 8, 1};
+    return t;
+  }
+  // Number of bytes of a data entry.
+  size_t entry_bytes(const DLTensor& t) const {
+    size_t size = (t.dtype.bits * t.dtype.lanes + 7) / 8;
+    for (int i = 0; i < t.ndim; ++i) {
+      size *= static_cast<size_t>(t.shape[i]);
+    }
+    return size;
+  }
   // The graph nodes.
   std::vector<Node> nodes_;
   // The argument nodes.
@@ -375,23 +854,78 @@ class GraphRuntime : public ModuleNode {
   GraphAttr attrs_;
   /*! \brief The code module */
   tvm::runtime::Module module_;
-  /*! \brief execution context */
+  /*! \brief execution context, the first one of ctxs_ */
   TVMContext ctx_;
+  /*! \brief all the execution contexts */
+  std::vector<TVMContext> ctxs_;
   /*! \brief common storage pool */
   std::vector<DLTensor*> storage_pool_;
   /*! \brief data entry of each node */
   std::vector<DLTensor> data_entry_;
+  /*! \brief the order in which the nodes run */
+  std::vector<uint32_t> exec_order_;
+  /*! \brief compiled run plan, empty when Run uses op_execs_ */
+  std::vector<RunStep> run_plan_;
+  /*! \brief packed argument values of the run plan */
+  std::vector<TVMValue> plan_values_;
+  /*! \brief packed argument type codes of the run plan */
+  std::vector<int> plan_tcodes_;
+  /*! \brief completion callback of each output */
+  std::vector<PackedFunc> output_callbacks_;
+  /*! \brief number of registered output callbacks */
+  size_t num_output_callbacks_{0};
+  /*! \brief the outputs that are ready after each node runs */
+  std::vector<std::vector<uint32_t> > node_outputs_;
+  /*! \brief the outputs that are graph inputs, ready before the run */
+  std::vector<uint32_t> input_outputs_;
+  /*! \brief whether each node gates other nodes */
+  std::vector<bool> is_gate_;
+  /*! \brief the state of each gate in the current run, empty without gates */
+  std::vector<uint8_t> gate_open_;
   /*! \brief operator on each node */
   std::vector<std::function<void()> > op_execs_;
+  /*! \brief arguments captured by each operator */
+  std::vector<std::shared_ptr<OpArgs> > op_args_;
+  /*! \brief entries whose leading dimension is the symbolic batch */
+  std::vector<uint32_t> batch_entries_;
+  /*! \brief bytes of each data entry, planned for the maximum batch */
+  std::vector<size_t> data_entry_bytes_;
+  /*! \brief copies of entries consumed on another device */
+  std::vector<DLTensor> copy_entry_;
+  /*! \brief the run in which each copy was last made */
+  std::vector<uint64_t> copy_epoch_;
+  /*! \brief counts the runs, a copy made in an earlier run is stale */
+  uint64_t run_epoch_{0};
+  /*! \brief backend workspace events of a warm run */
+  std::vector<WorkspaceEvent> warm_state_;
+  /*! \brief the module of the shared arena */
+  Module shared_arena_;
+  /*! \brief the shared arena, nullptr when the activations are owned */
+  SharedArena* arena_{nullptr};
+  /*! \brief whether the leased block is kept between runs */
+  bool pin_arena_{false};
+  /*! \brief bytes leased from the shared arena at each run */
+  size_t arena_bytes_{0};
+  /*! \brief the block the leased entries point into */
+  void* arena_base_{nullptr};
+  /*! \brief nesting depth of the arena scopes */
+  int arena_depth_{0};
+  /*! \brief tensors placed in the leased block, with their byte offset */
+  std::vector<std::pair<DLTensor*, size_t> > arena_bindings_;
 };
 
 
-void GraphRuntime::LoadDLTensor(dmlc::Stream* strm, DLTensor* dst) {
+void GraphRuntime::LoadDLTensor(dmlc::Stream* strm, DLTensor* dst,
+                                const std::string& name) {
   uint64_t header, reserved;
   CHECK(strm->Read(&header, sizeof(header)))
       << "Invalid DLTensor file format";
   CHECK(strm->Read(&reserved, sizeof(reserved)))
       << "Invalid DLTensor file format";
+  if (header == kTVMQuantizedNDArrayMagic) {
+    this->LoadQuantizedDLTensor(strm, dst, name);
+    return;
+  }
   CHECK(header == kTVMNDArrayMagic)
       << "Invalid DLTensor file format";
 
@@ -430,6 +964,213 @@ void GraphRuntime::LoadDLTensor(dmlc::Stream* strm, DLTensor* dst) {
   TVM_CCALL(TVMArrayCopyFromBytes(dst, &bytes[0], data_byte_size));
 }
 
+// Convert the bits of an IEEE half to float, branches compile to selects.
+inline float HalfToFloat(uint16_t h) {
+  const uint32_t shifted_exp = 0x7c00U << 13;
+  uint32_t bits = static_cast<uint32_t>(h & 0x7fff) << 13;
+  uint32_t exp = shifted_exp & bits;
+  bits += (127 - 15) << 23;
+  if (exp == shifted_exp) {
+    // Inf or NaN
+    bits += (128 - 16) << 23;
+  } else if (exp == 0) {
+    // zero or subnormal, renormalize by float arithmetic
+    const uint32_t magic_bits = 113U << 23;
+    float magic, f;
+    bits += 1 << 23;
+    std::memcpy(&magic, &magic_bits, sizeof(magic));
+    std::memcpy(&f, &bits, sizeof(f));
+    f -= magic;
+    std::memcpy(&bits, &f, sizeof(f));
+  }
+  bits |= static_cast<uint32_t>(h & 0x8000) << 16;
+  float ret;
+  std::memcpy(&ret, &bits, sizeof(ret));
+  return ret;
+}
+
+/*!
+ * \brief Closure of the parallel dequantize kernel.
+ *
+ *  The data is viewed as rows of inner elements, each row
+ *  shares the scale of its channel.
+ */
+struct DequantizeClosure {
+  const void* src;
+  float* dst;
+  const float* scales;
+  int64_t num_rows;
+  int64_t num_channels;
+  int64_t inner;
+  DLDataTypeCode code;
+};
+
+int DequantizeKernel(int task_id, TVMParallelGroupEnv* penv, void* cdata) {
+  const DequantizeClosure* c = static_cast<const DequantizeClosure*>(cdata);
+  int64_t step = (c->num_rows + penv->num_task - 1) / penv->num_task;
+  int64_t begin = std::min(c->num_rows, step * task_id);
+  int64_t end = std::min(c->num_rows, begin + step);
+  for (int64_t row = begin; row < end; ++row) {
+    float scale = c->scales == nullptr ? 1.0f :
+        c->scales[c->num_channels == 1 ? 0 : row % c->num_channels];
+    float* dst = c->dst + row * c->inner;
+    if (c->code == kDLInt) {
+      const int8_t* src = static_cast<const int8_t*>(c->src) + row * c->inner;
+      for (int64_t i = 0; i < c->inner; ++i) {
+        dst[i] = static_cast<float>(src[i]) * scale;
+      }
+    } else {
+      const uint16_t* src = static_cast<const uint16_t*>(c->src) + row * c->inner;
+      for (int64_t i = 0; i < c->inner; ++i) {
+        dst[i] = HalfToFloat(src[i]) * scale;
+      }
+    }
+  }
+  return 0;
+}
+
+void GraphRuntime::LoadQuantizedDLTensor(dmlc::Stream* strm, DLTensor* dst,
+                                         const std::string& name) {
+  DLTensor tensor;
+  CHECK(strm->Read(&tensor.ctx, sizeof(tensor.ctx)))
+      << "Invalid DLTensor file format";
+  CHECK(strm->Read(&tensor.ndim, sizeof(tensor.ndim)))
+      << "Invalid DLTensor file format";
+  CHECK(strm->Read(&tensor.dtype, sizeof(tensor.dtype)))
+      << "Invalid DLTensor file format";
+  std::vector<int64_t> shape(tensor.ndim);
+  if (tensor.ndim != 0) {
+    CHECK(strm->Read(&shape[0], sizeof(int64_t) * tensor.ndim))
+        << "Invalid DLTensor file format";
+  }
+  int32_t axis;
+  CHECK(strm->Read(&axis, sizeof(axis)))
+      << "Invalid DLTensor file format";
+  std::vector<float> scales;
+  CHECK(strm->Read(&scales))
+      << "Invalid DLTensor file format";
+  CHECK((tensor.dtype.code == kDLInt && tensor.dtype.bits == 8) ||
+        (tensor.dtype.code == kDLFloat && tensor.dtype.bits == 16))
+      << "quantized param must be int8 or float16";
+  CHECK_EQ(tensor.dtype.lanes, 1U);
+  CHECK_EQ(tensor.ndim, dst->ndim) << "param dimension mismatch";
+  for (int i = 0; i < tensor.ndim; ++i) {
+    CHECK_EQ(shape[i], dst->shape[i]) << "param shape mismatch";
+  }
+  int64_t outer = 1, num_channels = 1, inner = 1;
+  if (scales.size() > 1) {
+    CHECK(axis >= 0 && axis < tensor.ndim) << "Invalid DLTensor file format";
+    num_channels = shape[axis];
+    CHECK_EQ(scales.size(), static_cast<size_t>(num_channels))
+        << "need one scale per channel";
+  }
+  for (int i = 0; i < tensor.ndim; ++i) {
+    if (scales.size() > 1 && i < axis) {
+      outer *= shape[i];
+    } else if (scales.size() <= 1 || i > axis) {
+      inner *= shape[i];
+    }
+  }
+  size_t num_elems = static_cast<size_t>(outer * num_channels * inner);
+  uint64_t data_byte_size;
+  CHECK(strm->Read(&data_byte_size, sizeof(data_byte_size)))
+      << "Invalid DLTensor file format";
+  CHECK(data_byte_size == num_elems * tensor.dtype.bits / 8)
+      << "Invalid DLTensor file format";
+  std::vector<uint8_t> bytes(data_byte_size + 1);
+  CHECK(strm->Read(&bytes[0], data_byte_size))
+      << "Invalid DLTensor file format";
+  if (tensor.dtype.code == dst->dtype.code &&
+      tensor.dtype.bits == dst->dtype.bits &&
+      tensor.dtype.lanes == dst->dtype.lanes) {
+    // kernels consume the quantized data directly, and read the scales
+    // from the companion input.
+    TVM_CCALL(TVMArrayCopyFromBytes(dst, &bytes[0], data_byte_size));
+    if (scales.size() == 0) return;
+    const std::string scale_name = name + "_scale";
+    for (uint32_t nid : input_nodes_) {
+      if (nodes_[nid].name != scale_name) continue;
+      DLTensor* scale = &data_entry_[this->entry_id(nid, 0)];
+      CHECK(scale->dtype.code == kDLFloat && scale->dtype.bits == 32 &&
+            scale->dtype.lanes == 1) << scale_name << " must be float32";
+      int64_t size = 1;
+      for (int i = 0; i < scale->ndim; ++i) size *= scale->shape[i];
+      CHECK_EQ(size, static_cast<int64_t>(scales.size()))
+          << scale_name << " must hold one scale per channel";
+      TVM_CCALL(TVMArrayCopyFromBytes(
+          scale, scales.data(), scales.size() * sizeof(float)));
+      return;
+    }
+    LOG(FATAL) << "quantized param " << name << " has scales but the graph "
+               << "has no float32 input " << scale_name
+               << ", load it into a float32 input instead";
+  }
+  CHECK(dst->dtype.code == kDLFloat && dst->dtype.bits == 32 &&
+        dst->dtype.lanes == 1) << "param type mismatch";
+  std::vector<float> values(num_elems);
+  DequantizeClosure closure;
+  closure.src = &bytes[0];
+  closure.dst = values.data();
+  closure.scales = scales.size() == 0 ? nullptr : scales.data();
+  closure.num_rows = outer * num_channels;
+  closure.num_channels = num_channels;
+  closure.inner = inner;
+  closure.code = static_cast<DLDataTypeCode>(tensor.dtype.code);
+  // Only go parallel when the tensor is large enough to pay for the launch.
+  if (num_elems >= (1 << 16)) {
+    TVM_CCALL(TVMBackendParallelLaunch(DequantizeKernel, &closure, 0));
+  } else {
+    TVMParallelGroupEnv env;
+    env.sync_handle = nullptr;
+    env.num_task = 1;
+    DequantizeKernel(0, &env, &closure);
+  }
+  TVM_CCALL(TVMArrayCopyFromBytes(dst, values.data(), num_elems * sizeof(float)));
+}
+
+void GraphRuntime::LoadBinary(dmlc::Stream* strm) {
+  uint64_t header, reserved;
+  CHECK(strm->Read(&header))
+      << "Invalid binary graph format";
+  CHECK(header == kTVMGraphBinaryMagic)
+      << "Invalid binary graph format";
+  CHECK(strm->Read(&reserved))
+      << "Invalid binary graph format";
+  uint64_t num_nodes;
+  CHECK(strm->Read(&num_nodes))
+      << "Invalid binary graph format";
+  nodes_.resize(static_cast<size_t>(num_nodes));
+  for (Node& node : nodes_) {
+    CHECK(node.Load(strm))
+        << "Invalid binary graph format";
+  }
+  CHECK(strm->Read(&input_nodes_))
+      << "Invalid binary graph format";
+  CHECK(strm->Read(&node_row_ptr_))
+      << "Invalid binary graph format";
+  CHECK(strm->Read(&outputs_))
+      << "Invalid binary graph format";
+  CHECK(attrs_.Load(strm))
+      << "Invalid binary graph format";
+  CHECK_EQ(node_row_ptr_.size(), nodes_.size() + 1)
+      << "Invalid binary graph format";
+}
+
+void GraphRuntime::SaveBinary(dmlc::Stream* strm) const {
+  uint64_t header = kTVMGraphBinaryMagic, reserved = 0;
+  strm->Write(header);
+  strm->Write(reserved);
+  uint64_t num_nodes = nodes_.size();
+  strm->Write(num_nodes);
+  for (const Node& node : nodes_) {
+    node.Save(strm);
+  }
+  strm->Write(input_nodes_);
+  strm->Write(node_row_ptr_);
+  strm->Write(outputs_);
+  attrs_.Save(strm);
+}
+
 void GraphRuntime::LoadParams(dmlc::Stream* strm) {
   uint64_t header, reserved;
   CHECK(strm->Read(&header))
@@ -452,18 +1193,58 @@ void GraphRuntime::LoadParams(dmlc::Stream* strm) {
     uint32_t in_idx = GetInputIndex(names[i]);
     uint32_t eid = this->entry_id(input_nodes_[in_idx], 0);
     CHECK_LT(eid, data_entry_.size());
-    LoadDLTensor(strm, &data_entry_[eid]);
+    LoadDLTensor(strm, &data_entry_[eid], names[i]);
+  }
+}
+
+void GraphRuntime::SetupEntries() {
+  const std::vector<TVMType>& vtype = attrs_.dltype;
+  data_entry_.resize(num_node_entries());
+  // Each entry lives on the device of the node that produces it.
+  CHECK(attrs_.device_index.size() == 0 ||
+        attrs_.device_index.size() == nodes_.size())
+      << "device_index must have one value per node";
+  for (uint32_t nid = 0; nid < this->num_nodes(); ++nid) {
+    int device = node_device(nid);
+    CHECK(device >= 0 && static_cast<size_t>(device) < ctxs_.size())
+        << "node " << nodes_[nid].name << " is assigned to device "
+        << device << ", but only " << ctxs_.size() << " contexts are given";
+    for (uint32_t i = node_row_ptr_[nid]; i < node_row_ptr_[nid + 1]; ++i) {
+      data_entry_[i].ctx = ctxs_[device];
+    }
+  }
+  data_entry_bytes_.resize(attrs_.shape.size());
+  for (size_t i = 0; i < attrs_.shape.size(); ++i) {
+    // A leading -1 marks the symbolic batch dimension,
+    // plan the storage for the maximum batch.
+    std::vector<int64_t>& shape = attrs_.shape[i];
+    if (shape.size() != 0 && shape[0] == -1) {
+      CHECK_GT(attrs_.max_batch_size, 0)
+          << "graph with symbolic batch dimension requires max_batch_size";
+      shape[0] = attrs_.max_batch_size;
+      batch_entries_.push_back(static_cast<uint32_t>(i));
+    }
+    size_t size = 1;
+    for (int64_t sz : shape) {
+      CHECK_GE(sz, 0) << "Do not support runtime shape op";
+      size *= static_cast<size_t>(sz);
+    }
+    DLDataType t = vtype[i];
+    size_t bits = t.bits * t.lanes;
+    CHECK_EQ(bits % 8U, 0U);
+    data_entry_bytes_[i] = (bits / 8U) * size;
+    data_entry_[i].data = nullptr;
+    data_entry_[i].shape = const_cast<int64_t*>(shape.data());
+    data_entry_[i].ndim = static_cast<int>(shape.size());
+    data_entry_[i].dtype = t;
+    data_entry_[i].strides = nullptr;
+    data_entry_[i].byte_offset = 0;
   }
 }
 
 void GraphRuntime::SetupStorage() {
+  this->SetupEntries();
   // Grab saved optimization plan from graph.
-  std::vector<TVMType> vtype;
-  for (const std::string& s_type : attrs_.dltype) {
-    vtype.push_back(tvm::runtime::String2TVMType(s_type));
-  }
-  data_entry_.resize(num_node_entries());
-  // Find the maximum space size.
   int max_id = 0;
   for (size_t i = 0; i < attrs_.shape.size(); ++i) {
     max_id = std::max(attrs_.storage_id[i] + 1, max_id);
@@ -471,76 +1252,1052 @@ void GraphRuntime::SetupStorage() {
   for (uint32_t nid : input_nodes_) {
     attrs_.storage_id[this->entry_id(nid, 0)] = max_id++;
   }
-  // size of each storage pool entry
+  std::vector<int> entry_device(num_node_entries());
+  for (uint32_t nid = 0; nid < this->num_nodes(); ++nid) {
+    for (uint32_t i = node_row_ptr_[nid]; i < node_row_ptr_[nid + 1]; ++i) {
+      entry_device[i] = node_device(nid);
+    }
+  }
+  // size and device of each storage pool entry,
+  // the same storage id is split when it is used on several devices.
   std::vector<size_t> pool_entry_bytes;
+  std::vector<int> pool_entry_device;
+  std::map<std::pair<int, int>, size_t> pool_index;
+  std::vector<size_t> entry_pool(attrs_.shape.size());
   // Find the maximum space size.
   for (size_t i = 0; i < attrs_.shape.size(); ++i) {
-    int storage_id = attrs_.storage_id[i];
-    size_t size = 1;
-    for (int64_t sz : attrs_.shape[i]) {
-      size *= static_cast<size_t>(sz);
+    // Entries the planner could not assign get their own storage.
+    if (attrs_.storage_id[i] < 0) {
+      attrs_.storage_id[i] = max_id++;
     }
-    CHECK_GE(storage_id, 0) << "Do not support runtime shape op";
-    DLDataType t = vtype[i];
-    size_t bits = t.bits * t.lanes;
-    CHECK_EQ(bits % 8U, 0U);
-    size_t bytes = (bits / 8U) * size;
-
-    size_t sid = static_cast<size_t>(storage_id);
-    if (sid >= pool_entry_bytes.size()) {
-      pool_entry_bytes.resize(sid + 1, 0);
+    int storage_id = attrs_.storage_id[i];
+    size_t bytes = data_entry_bytes_[i];
+    auto key = std::make_pair(storage_id, entry_device[i]);
+    auto it = pool_index.find(key);
+    if (it == pool_index.end()) {
+      it = pool_index.insert({key, pool_entry_bytes.size()}).first;
+      pool_entry_bytes.push_back(0);
+      pool_entry_device.push_back(entry_device[i]);
     }
-    pool_entry_bytes[sid] = std::max(pool_entry_bytes[sid], bytes);
+    entry_pool[i] = it->second;
+    pool_entry_bytes[it->second] = std::max(pool_entry_bytes[it->second], bytes);
   }
   // Allocate the space.
   for (size_t i = 0; i < pool_entry_bytes.size(); ++i) {
     int64_t shape[] = {static_cast<int64_t>(pool_entry_bytes[i] + 3) / 4};
+    const TVMContext& ctx = ctxs_[pool_entry_device[i]];
     DLTensor* tensor;
     TVM_CCALL(TVMArrayAlloc(
-        shape, 1, kDLFloat, 32, 1, ctx_.device_type, ctx_.device_id, &tensor));
+        shape, 1, kDLFloat, 32, 1, ctx.device_type, ctx.device_id, &tensor));
     storage_pool_.push_back(tensor);
   }
   // Assign the pooled entries.
   for (size_t i = 0; i < data_entry_.size(); ++i) {
-    int storage_id = attrs_.storage_id[i];
-    CHECK_LT(static_cast<size_t>(storage_id), storage_pool_.size());
-    data_entry_[i] = *storage_pool_[storage_id];
-    data_entry_[i].shape = const_cast<int64_t*>(attrs_.shape[i].data());
-    data_entry_[i].ndim = static_cast<int>(attrs_.shape[i].size());
-    data_entry_[i].dtype = vtype[i];
+    data_entry_[i].data = storage_pool_[entry_pool[i]]->data;
   }
 }
 
 void GraphRuntime::SetupOpExecs() {
   op_execs_.resize(this->num_nodes());
+  op_args_.resize(this->num_nodes());
+  exec_order_.resize(this->num_nodes());
+  std::iota(exec_order_.begin(), exec_order_.end(), 0);
+  // producer device of each entry.
+  std::vector<int> entry_device(num_node_entries());
+  for (uint32_t nid = 0; nid < this->num_nodes(); ++nid) {
+    for (uint32_t i = node_row_ptr_[nid]; i < node_row_ptr_[nid + 1]; ++i) {
+      entry_device[i] = node_device(nid);
+    }
+  }
+  // (entry, device) -> index in copy_entry_
+  std::map<std::pair<uint32_t, int>, size_t> copy_index;
   // setup the array and requirements.
   for (uint32_t nid = 0; nid < this->num_nodes(); ++nid) {
     const auto& inode = nodes_[nid];
     if (inode.op_type == "null") continue;
+    int device = node_device(nid);
     std::vector<DLTensor> args;
+    std::vector<uint32_t> arg_eids;
+    // cross device copies to run before this node.
+    std::vector<std::pair<uint32_t, size_t> > copies;
     for (const auto& e : inode.inputs) {
-      args.push_back(data_entry_[this->entry_id(e)]);
+      uint32_t eid = this->entry_id(e);
+      arg_eids.push_back(eid);
+      if (entry_device[eid] == device) {
+        args.push_back(data_entry_[eid]);
+        continue;
+      }
+      CHECK_NE(inode.param.func_name, "__nop")
+          << "__nop node " << inode.name
+          << " must be on the same device as its inputs";
+      // Copy the entry once per device and run, the first consumer
+      // that runs makes the copy and later consumers reuse it.
+      auto key = std::make_pair(eid, device);
+      auto it = copy_index.find(key);
+      if (it == copy_index.end()) {
+        int64_t shape[] = {static_cast<int64_t>(data_entry_bytes_[eid] + 3) / 4};
+        const TVMContext& ctx = ctxs_[device];
+        DLTensor* tensor;
+        TVM_CCALL(TVMArrayAlloc(
+            shape, 1, kDLFloat, 32, 1, ctx.device_type, ctx.device_id, &tensor));
+        storage_pool_.push_back(tensor);
+        DLTensor copy = data_entry_[eid];
+        copy.data = tensor->data;
+        copy.ctx = tensor->ctx;
+        it = copy_index.insert({key, copy_entry_.size()}).first;
+        copy_entry_.push_back(copy);
+        copy_epoch_.push_back(0);
+      }
+      copies.emplace_back(eid, it->second);
+      args.push_back(copy_entry_[it->second]);
     }
     for (uint32_t index = 0; index < inode.param.num_outputs; ++index) {
       uint32_t eid = this->entry_id(nid, index);
+      arg_eids.push_back(eid);
       args.push_back(data_entry_[eid]);
     }
     CHECK_EQ(inode.op_type, "tvm_op")
         << "Can only take tvm_op as op";
-    op_execs_[nid] = CreateTVMOp(inode.param, args, inode.inputs.size());
+    std::tie(op_execs_[nid], op_args_[nid]) =
+        CreateTVMOp(inode.param, args, inode.inputs.size());
+    op_args_[nid]->arg_eids = std::move(arg_eids);
+    if (copies.size() != 0) {
+      std::function<void()> fexec = op_execs_[nid];
+      op_execs_[nid] = [this, copies, fexec]() {
+        for (const auto& c : copies) {
+          if (copy_epoch_[c.second] == run_epoch_) continue;
+          TVM_CCALL(TVMArrayCopyFromTo(
+              &data_entry_[c.first], &copy_entry_[c.second], nullptr));
+          copy_epoch_[c.second] = run_epoch_;
+        }
+        fexec();
+      };
+    }
+  }
+}
+
+void GraphRuntime::SetBatchSize(int64_t batch_size) {
+  CHECK_GT(attrs_.max_batch_size, 0)
+      << "graph does not have a symbolic batch dimension";
+  CHECK(batch_size >= 1 && batch_size <= attrs_.max_batch_size)
+      << "batch size " << batch_size << " out of range [1, "
+      << attrs_.max_batch_size << "]";
+  // data_entry_ and the op arguments point to the shapes in attrs_.
+  for (uint32_t eid : batch_entries_) {
+    attrs_.shape[eid][0] = batch_size;
+  }
+  // flattened arguments keep a private copy of their shape.
+  for (const auto& op_arg : op_args_) {
+    if (op_arg == nullptr || op_arg->shape_data.size() == 0) continue;
+    for (size_t i = 0; i < op_arg->arg_eids.size(); ++i) {
+      const std::vector<int64_t>& shape = attrs_.shape[op_arg->arg_eids[i]];
+      op_arg->shape_data[i] = std::accumulate(
+          shape.begin(), shape.end(), static_cast<int64_t>(1),
+          std::multiplies<int64_t>());
+    }
+  }
+}
+
+std::string GraphRuntime::Profile(int number, int warmup) {
+  CHECK_GT(number, 0) << "number of profiled runs must be positive";
+  ArenaScope scope(this);
+  for (int i = 0; i < warmup; ++i) {
+    this->Run();
+  }
+  for (const TVMContext& ctx : ctxs_) {
+    DeviceAPI::Get(ctx)->StreamSync(ctx, nullptr);
+  }
+  // run as Run does, nodes behind closed gates are skipped.
+  std::vector<double> time_sec(op_execs_.size(), 0.0);
+  std::vector<int> num_runs(op_execs_.size(), 0);
+  for (int k = 0; k < number; ++k) {
+    this->RunEachNode(&time_sec, &num_runs);
+  }
+  std::ostringstream os;
+  dmlc::JSONWriter writer(&os);
+  writer.BeginArray();
+  for (uint32_t nid = 0; nid < this->num_nodes(); ++nid) {
+    if (!op_execs_[nid]) continue;
+    const auto& inode = nodes_[nid];
+    const OpArgs& op_arg = *op_args_[nid];
+    size_t bytes_read = 0, bytes_written = 0;
+    for (size_t i = 0; i < op_arg.arg_eids.size(); ++i) {
+      size_t nbytes = entry_bytes(data_entry_[op_arg.arg_eids[i]]);
+      if (i < inode.inputs.size()) {
+        bytes_read += nbytes;
+      } else {
+        bytes_written += nbytes;
+      }
+    }
+    writer.WriteArraySeperator();
+    writer.BeginObject(false);
+    writer.WriteObjectKeyValue("node_id", nid);
+    writer.WriteObjectKeyValue("name", inode.name);
+    writer.WriteObjectKeyValue("func_name", inode.param.func_name);
+    writer.WriteObjectKeyValue(
+        "time_us", num_runs[nid] != 0 ? time_sec[nid] * 1e6 / num_runs[nid] : 0.0);
+    writer.WriteObjectKeyValue("num_runs", num_runs[nid]);
+    writer.WriteObjectKeyValue("bytes_read", bytes_read);
+    writer.WriteObjectKeyValue("bytes_written", bytes_written);
+    writer.EndObject();
+  }
+  writer.EndArray();
+  return os.str();
+}
+
+// Fill every element of a host buffer of the given type with value.
+void FillSynthetic(std::vector<uint8_t>* buf, TVMType type, double value) {
+  size_t elem_bytes = (type.bits * type.lanes + 7) / 8;
+  size_t num_elems = buf->size() / elem_bytes;
+  uint8_t* data = buf->data();
+  if (type.code == kDLFloat && type.bits == 32) {
+    float v = static_cast<float>(value);
+    for (size_t i = 0; i < num_elems * type.lanes; ++i) {
+      std::memcpy(data + i * sizeof(v), &v, sizeof(v));
+    }
+  } else if (type.code == kDLFloat && type.bits == 64) {
+    for (size_t i = 0; i < num_elems * type.lanes; ++i) {
+      std::memcpy(data + i * sizeof(value), &value, sizeof(value));
+    }
+  } else if ((type.code == kDLInt || type.code == kDLUInt) &&
+             type.bits % 8 == 0 && type.bits <= 64) {
+    int64_t v = static_cast<int64_t>(value);
+    size_t nbytes = type.bits / 8;
+    for (size_t i = 0; i < num_elems * type.lanes; ++i) {
+      // little endian truncation of v
+      std::memcpy(data + i * nbytes, &v, nbytes);
+    }
+  } else {
+    std::fill(buf->begin(), buf->end(), 0);
+  }
+}
+
+std::string GraphRuntime::Warmup(int number, double fill_value) {
+  CHECK_GT(number, 0) << "number of warmup runs must be positive";
+  typedef std::chrono::high_resolution_clock Clock;
+  auto elapsed_us = [](Clock::time_point begin) {
+    return std::chrono::duration_cast<std::chrono::duration<double, std::micro> >(
+        Clock::now() - begin).count();
+  };
+  // Keep the inputs that were already set, e.g. the loaded params.
+  std::vector<std::vector<uint8_t> > saved(input_nodes_.size());
+  for (size_t i = 0; i < input_nodes_.size(); ++i) {
+    DLTensor* t = &data_entry_[this->entry_id(input_nodes_[i], 0)];
+    saved[i].resize(entry_bytes(*t));
+    TVM_CCALL(TVMArrayCopyToBytes(t, saved[i].data(), saved[i].size()));
+  }
+  // Fault in the pages of every buffer.
+  auto tbegin = Clock::now();
+  for (DLTensor* t : storage_pool_) {
+    std::vector<uint8_t> zeros(static_cast<size_t>(t->shape[0]) * 4, 0);
+    TVM_CCALL(TVMArrayCopyFromBytes(t, zeros.data(), zeros.size()));
+  }
+  double prefault_us = elapsed_us(tbegin);
+  for (size_t i = 0; i < input_nodes_.size(); ++i) {
+    DLTensor* t = &data_entry_[this->entry_id(input_nodes_[i], 0)];
+    std::vector<uint8_t> buf(saved[i].size());
+    FillSynthetic(&buf, t->dtype, fill_value);
+    TVM_CCALL(TVMArrayCopyFromBytes(t, buf.data(), buf.size()));
+  }
+  // The first run pays for lazy initialization, e.g. TVMBackendRunOnce.
+  double first_run_us = 0, run_us = 0;
+  for (int k = 0; k < number; ++k) {
+    if (k == 0) StartWorkspaceTrace();
+    tbegin = Clock::now();
+    this->Run();
+    for (const TVMContext& ctx : ctxs_) {
+      DeviceAPI::Get(ctx)->StreamSync(ctx, nullptr);
+    }
+    if (k == 0) {
+      first_run_us = elapsed_us(tbegin);
+      warm_state_ = StopWorkspaceTrace();
+    } else {
+      run_us += elapsed_us(tbegin);
+    }
+  }
+  for (size_t i = 0; i < input_nodes_.size(); ++i) {
+    DLTensor* t = &data_entry_[this->entry_id(input_nodes_[i], 0)];
+    TVM_CCALL(TVMArrayCopyFromBytes(t, saved[i].data(), saved[i].size()));
+  }
+  size_t workspace_bytes = 0;
+  for (const WorkspaceEvent& e : warm_state_) {
+    workspace_bytes += static_cast<size_t>(e.nbytes);
+  }
+  std::ostringstream os;
+  dmlc::JSONWriter writer(&os);
+  writer.BeginObject(false);
+  writer.WriteObjectKeyValue("prefault_us", prefault_us);
+  writer.WriteObjectKeyValue("first_run_us", first_run_us);
+  writer.WriteObjectKeyValue("run_us", number > 1 ? run_us / (number - 1) : first_run_us);
+  writer.WriteObjectKeyValue("storage_bytes", this->MemoryFootprint());
+  writer.WriteObjectKeyValue("workspace_bytes", workspace_bytes);
+  writer.EndObject();
+  return os.str();
+}
+
+void GraphRuntime::SaveWarmState(dmlc::Stream* strm) const {
+  uint64_t header = kTVMGraphWarmStateMagic, reserved = 0;
+  strm->Write(header);
+  strm->Write(reserved);
+  uint64_t num_events = warm_state_.size();
+  strm->Write(num_events);
+  for (const WorkspaceEvent& e : warm_state_) {
+    strm->Write(static_cast<int32_t>(e.ctx.device_type));
+    strm->Write(static_cast<int32_t>(e.ctx.device_id));
+    strm->Write(e.nbytes);
+    strm->Write(&e.type_hint, sizeof(e.type_hint));
+    strm->Write(e.free_of);
+  }
+}
+
+void GraphRuntime::LoadWarmState(dmlc::Stream* strm) {
+  uint64_t header, reserved, num_events;
+  CHECK(strm->Read(&header) && header == kTVMGraphWarmStateMagic)
+      << "Invalid warm state format";
+  CHECK(strm->Read(&reserved) && strm->Read(&num_events))
+      << "Invalid warm state format";
+  std::vector<WorkspaceEvent> events(static_cast<size_t>(num_events));
+  for (WorkspaceEvent& e : events) {
+    int32_t device_type, device_id;
+    CHECK(strm->Read(&device_type) && strm->Read(&device_id) &&
+          strm->Read(&e.nbytes) &&
+          strm->Read(&e.type_hint, sizeof(e.type_hint)) &&
+          strm->Read(&e.free_of))
+        << "Invalid warm state format";
+    e.ctx.device_type = static_cast<DLDeviceType>(device_type);
+    e.ctx.device_id = device_id;
+  }
+  // Replay on the calling thread, freed pages stay in its workspace pool.
+  std::vector<void*> ptrs(events.size(), nullptr);
+  for (size_t i = 0; i < events.size(); ++i) {
+    const WorkspaceEvent& e = events[i];
+    if (e.free_of < 0) {
+      ptrs[i] = TVMBackendAllocWorkspace(
+          e.ctx.device_type, e.ctx.device_id, e.nbytes,
+          e.type_hint.code, e.type_hint.bits);
+      CHECK(ptrs[i] != nullptr) << "failed to allocate warm workspace";
+    } else {
+      CHECK_LT(static_cast<size_t>(e.free_of), i) << "Invalid warm state format";
+      void*& ptr = ptrs[static_cast<size_t>(e.free_of)];
+      CHECK(ptr != nullptr) << "Invalid warm state format";
+      TVM_CCALL(TVMBackendFreeWorkspace(e.ctx.device_type, e.ctx.device_id, ptr));
+      ptr = nullptr;
+    }
+  }
+  // Release what the trace did not free, newest first.
+  for (size_t i = ptrs.size(); i != 0; --i) {
+    if (ptrs[i - 1] != nullptr) {
+      const WorkspaceEvent& e = events[i - 1];
+      TVM_CCALL(TVMBackendFreeWorkspace(e.ctx.device_type, e.ctx.device_id, ptrs[i - 1]));
+    }
+  }
+  warm_state_ = std::move(events);
+}
+
+// Whether the function is a lone shape-only operator, e.g. fuse_reshape_1.
+bool IsShapeOnlyFunc(std::string func_name) {
+  static const char* kShapeOps[] = {
+    "reshape", "flatten", "squeeze", "expand_dims"};
+  if (func_name.compare(0, 5, "fuse_") == 0) {
+    func_name = func_name.substr(5);
+  }
+  size_t pos = func_name.find_last_not_of("0123456789");
+  if (pos != std::string::npos && pos + 1 < func_name.length() &&
+      func_name[pos] == '_') {
+    func_name = func_name.substr(0, pos);
+  }
+  for (const char* op : kShapeOps) {
+    if (func_name == op) return true;
+  }
+  return false;
+}
+
+size_t GraphRuntime::FuseShapeOps(size_t alignment) {
+  // Aliasing needs a runtime memory plan.
+  if (!this->CanPlanMemory()) return 0;
+  std::vector<bool> is_batch(this->num_node_entries(), false);
+  for (uint32_t eid : batch_entries_) {
+    is_batch[eid] = true;
+  }
+  // gates must run, their output is read by the executor.
+  std::vector<bool> is_gate(this->num_nodes(), false);
+  for (int gate : attrs_.gate) {
+    if (gate >= 0 && static_cast<uint32_t>(gate) < this->num_nodes()) {
+      is_gate[gate] = true;
+    }
+  }
+  size_t num_fused = 0;
+  for (uint32_t nid = 0; nid < this->num_nodes(); ++nid) {
+    auto& inode = nodes_[nid];
+    if (inode.op_type == "null" || is_gate[nid] ||
+        inode.inputs.size() != 1 ||
+        inode.param.num_outputs != 1 ||
+        !IsShapeOnlyFunc(inode.param.func_name)) continue;
+    uint32_t in_eid = this->entry_id(inode.inputs[0]);
+    uint32_t out_eid = this->entry_id(nid, 0);
+    const DLDataType& in_type = attrs_.dltype[in_eid];
+    const DLDataType& out_type = attrs_.dltype[out_eid];
+    if (in_type.code != out_type.code ||
+        in_type.bits != out_type.bits ||
+        in_type.lanes != out_type.lanes ||
+        is_batch[in_eid] != is_batch[out_eid] ||
+        data_entry_bytes_[in_eid] != data_entry_bytes_[out_eid]) continue;
+    inode.param.func_name = "__nop";
+    op_execs_[nid] = nullptr;
+    ++num_fused;
+  }
+  if (num_fused != 0) {
+    run_plan_.clear();
+    this->PlanMemory(alignment);
+  }
+  return num_fused;
+}
+
+std::vector<uint32_t> GraphRuntime::AliasGroups() const {
+  uint32_t num_entries = this->num_node_entries();
+  std::vector<uint32_t> group(num_entries);
+  for (uint32_t i = 0; i < num_entries; ++i) group[i] = i;
+  auto find_group = [&group](uint32_t eid) {
+    while (group[eid] != eid) eid = group[eid] = group[group[eid]];
+    return eid;
+  };
+  for (uint32_t nid = 0; nid < this->num_nodes(); ++nid) {
+    const auto& inode = nodes_[nid];
+    if (inode.op_type == "null" || inode.param.func_name != "__nop") continue;
+    size_t n = std::min(inode.inputs.size(),
+                        static_cast<size_t>(inode.param.num_outputs));
+    for (size_t i = 0; i < n; ++i) {
+      group[find_group(this->entry_id(nid, i))] =
+          find_group(this->entry_id(inode.inputs[i]));
+    }
+  }
+  for (uint32_t i = 0; i < num_entries; ++i) {
+    group[i] = find_group(i);
+  }
+  return group;
+}
+
+size_t GraphRuntime::PlanMemory(size_t alignment) {
+  CHECK(this->CanPlanMemory())
+      << "runtime memory plan requires a single device with addressable memory";
+  uint32_t num_entries = this->num_node_entries();
+  // Outputs of __nop are views of the inputs, group them together.
+  std::vector<uint32_t> group = this->AliasGroups();
+  auto find_group = [&group](uint32_t eid) {
+    return group[eid];
+  };
+  // Liveness in node steps, inputs and outputs live through the whole run.
+  uint32_t last_step = this->num_nodes();
+  std::vector<PlannedBuffer> buffers(num_entries);
+  std::vector<bool> used(num_entries, false);
+  auto touch = [&](uint32_t eid, uint32_t step) {
+    PlannedBuffer& buf = buffers[find_group(eid)];
+    if (!used[find_group(eid)]) {
+      buf.start = buf.end = step;
+      used[find_group(eid)] = true;
+    }
+    buf.start = std::min(buf.start, step);
+    buf.end = std::max(buf.end, step);
+    buf.size = std::max(buf.size, data_entry_bytes_[eid]);
+  };
+  for (uint32_t nid : input_nodes_) {
+    touch(this->entry_id(nid, 0), 0);
+    touch(this->entry_id(nid, 0), last_step);
+  }
+  for (uint32_t step = 0; step < exec_order_.size(); ++step) {
+    uint32_t nid = exec_order_[step];
+    const auto& inode = nodes_[nid];
+    if (inode.op_type == "null") continue;
+    for (const auto& e : inode.inputs) {
+      touch(this->entry_id(e), step);
+    }
+    for (uint32_t index = 0; index < inode.param.num_outputs; ++index) {
+      touch(this->entry_id(nid, index), step);
+    }
+  }
+  for (const auto& e : outputs_) {
+    touch(this->entry_id(e), last_step);
+  }
+  for (uint32_t eid = 0; eid < num_entries; ++eid) {
+    if (!used[find_group(eid)]) touch(eid, last_step);
+  }
+  // With a shared arena only the inputs and outputs own memory,
+  // the other entries go to the block leased at each run.
+  std::vector<bool> owned(num_entries, arena_ == nullptr);
+  for (uint32_t nid : input_nodes_) owned[find_group(this->entry_id(nid, 0))] = true;
+  for (const auto& e : outputs_) owned[find_group(this->entry_id(e))] = true;
+  std::vector<PlannedBuffer> planned, leased;
+  std::vector<int> plan_index(num_entries, -1);
+  for (uint32_t eid = 0; eid < num_entries; ++eid) {
+    if (!used[eid]) continue;
+    std::vector<PlannedBuffer>* dst = owned[eid] ? &planned : &leased;
+    plan_index[eid] = static_cast<int>(dst->size());
+    dst->push_back(buffers[eid]);
+  }
+  size_t total = PlanMemoryOffsets(&planned, alignment);
+  arena_bytes_ = PlanMemoryOffsets(&leased, alignment);
+  arena_bindings_.clear();
+  arena_base_ = nullptr;
+  // Allocate the arena and move the inputs over.
+  int64_t shape[] = {static_cast<int64_t>(std::max(total, alignment) + 3) / 4};
+  DLTensor* arena;
+  TVM_CCALL(TVMArrayAlloc(
+      shape, 1, kDLFloat, 32, 1, ctx_.device_type, ctx_.device_id, &arena));
+  std::vector<DLTensor> old_entry = data_entry_;
+  std::vector<size_t> leased_offset(num_entries, 0);
+  for (uint32_t eid = 0; eid < num_entries; ++eid) {
+    uint32_t root = find_group(eid);
+    int index = plan_index[root];
+    if (index < 0) continue;
+    if (owned[root]) {
+      data_entry_[eid].data =
+          static_cast<char*>(arena->data) + planned[index].offset;
+    } else {
+      data_entry_[eid].data = nullptr;
+      leased_offset[eid] = leased[index].offset;
+      arena_bindings_.push_back({&data_entry_[eid], leased_offset[eid]});
+    }
+  }
+  for (uint32_t nid : input_nodes_) {
+    uint32_t eid = this->entry_id(nid, 0);
+    TVM_CCALL(TVMArrayCopyFromTo(&old_entry[eid], &data_entry_[eid], nullptr));
+  }
+  for (DLTensor* t : storage_pool_) {
+    TVM_CCALL(TVMArrayFree(t));
+  }
+  storage_pool_.clear();
+  storage_pool_.push_back(arena);
+  // Rebind the arguments captured by the operators.
+  for (const auto& op_arg : op_args_) {
+    if (op_arg == nullptr) continue;
+    for (size_t i = 0; i < op_arg->arg_eids.size(); ++i) {
+      uint32_t eid = op_arg->arg_eids[i];
+      op_arg->args[i].data = data_entry_[eid].data;
+      if (!owned[find_group(eid)]) {
+        arena_bindings_.push_back({&op_arg->args[i], leased_offset[eid]});
+      }
+    }
+  }
+  return total;
+}
+
+std::pair<size_t, size_t> GraphRuntime::EstimateOrder(
+    const std::vector<uint32_t>& order,
+    const std::vector<uint32_t>& group) const {
+  uint32_t num_entries = this->num_node_entries();
+  std::vector<size_t> group_bytes(num_entries, 0);
+  for (uint32_t eid = 0; eid < num_entries; ++eid) {
+    group_bytes[group[eid]] = std::max(group_bytes[group[eid]], data_entry_bytes_[eid]);
+  }
+  // inputs and outputs are live through the whole run.
+  std::vector<bool> persistent(num_entries, false);
+  for (uint32_t nid : input_nodes_) persistent[group[this->entry_id(nid, 0)]] = true;
+  for (const auto& e : outputs_) persistent[group[this->entry_id(e)]] = true;
+  const uint32_t kNone = std::numeric_limits<uint32_t>::max();
+  std::vector<uint32_t> first(num_entries, kNone), last(num_entries, 0);
+  std::vector<uint32_t> produced(num_entries, 0);
+  size_t reuse_distance = 0;
+  for (uint32_t step = 0; step < order.size(); ++step) {
+    const auto& inode = nodes_[order[step]];
+    if (inode.op_type == "null") continue;
+    for (const auto& e : inode.inputs) {
+      uint32_t eid = this->entry_id(e);
+      last[group[eid]] = std::max(last[group[eid]], step);
+      if (nodes_[e.node_id].op_type != "null") {
+        reuse_distance += step - produced[eid];
+      }
+    }
+    for (uint32_t index = 0; index < inode.param.num_outputs; ++index) {
+      uint32_t eid = this->entry_id(order[step], index);
+      produced[eid] = step;
+      if (first[group[eid]] == kNone) first[group[eid]] = step;
+      last[group[eid]] = std::max(last[group[eid]], step);
+    }
+  }
+  size_t base = 0;
+  std::vector<int64_t> delta(order.size() + 1, 0);
+  for (uint32_t g = 0; g < num_entries; ++g) {
+    if (group[g] != g) continue;
+    if (persistent[g]) {
+      base += group_bytes[g];
+    } else if (first[g] != kNone) {
+      delta[first[g]] += group_bytes[g];
+      delta[last[g] + 1] -= group_bytes[g];
+    }
+  }
+  size_t peak = base;
+  int64_t live = static_cast<int64_t>(base);
+  for (size_t step = 0; step < order.size(); ++step) {
+    live += delta[step];
+    peak = std::max(peak, static_cast<size_t>(live));
+  }
+  return std::make_pair(peak, reuse_distance);
+}
+
+std::string GraphRuntime::OptimizeOrder(size_t alignment) {
+  CHECK(this->CanPlanMemory())
+      << "reordering requires a runtime memory plan, "
+      << "which needs a single device with addressable memory";
+  uint32_t num_entries = this->num_node_entries();
+  std::vector<uint32_t> group = this->AliasGroups();
+  std::vector<size_t> group_bytes(num_entries, 0);
+  for (uint32_t eid = 0; eid < num_entries; ++eid) {
+    group_bytes[group[eid]] = std::max(group_bytes[group[eid]], data_entry_bytes_[eid]);
+  }
+  std::vector<bool> persistent(num_entries, false);
+  for (uint32_t nid : input_nodes_) persistent[group[this->entry_id(nid, 0)]] = true;
+  for (const auto& e : outputs_) persistent[group[this->entry_id(e)]] = true;
+  // Dependencies, the remaining uses of each group and the consumers.
+  std::vector<uint32_t> num_deps(this->num_nodes(), 0);
+  std::vector<std::vector<uint32_t> > consumers(this->num_nodes());
+  std::vector<uint32_t> uses(num_entries, 0);
+  for (uint32_t nid = 0; nid < this->num_nodes(); ++nid) {
+    const auto& inode = nodes_[nid];
+    if (inode.op_type == "null") continue;
+    for (const auto& e : inode.inputs) {
+      ++uses[group[this->entry_id(e)]];
+      if (nodes_[e.node_id].op_type == "null") continue;
+      ++num_deps[nid];
+      consumers[e.node_id].push_back(nid);
+    }
+    for (uint32_t dep : inode.control_deps) {
+      if (nodes_[dep].op_type == "null") continue;
+      ++num_deps[nid];
+      consumers[dep].push_back(nid);
+    }
+    if (attrs_.gate.size() != 0 && attrs_.gate[nid] >= 0) {
+      ++num_deps[nid];
+      consumers[attrs_.gate[nid]].push_back(nid);
+    }
+  }
+  std::vector<bool> allocated(num_entries, false);
+  std::vector<uint32_t> produced(num_entries, 0);
+  std::vector<uint32_t> ready, order;
+  for (uint32_t nid = 0; nid < this->num_nodes(); ++nid) {
+    if (nodes_[nid].op_type == "null") {
+      order.push_back(nid);
+    } else if (num_deps[nid] == 0) {
+      ready.push_back(nid);
+    }
+  }
+  while (!ready.empty()) {
+    size_t best = 0;
+    int64_t best_delta = 0;
+    uint32_t best_recent = 0;
+    for (size_t i = 0; i < ready.size(); ++i) {
+      const auto& inode = nodes_[ready[i]];
+      // bytes allocated by the outputs minus bytes freed by the last uses.
+      int64_t delta = 0;
+      uint32_t recent = 0;
+      std::vector<uint32_t> seen;
+      for (uint32_t index = 0; index < inode.param.num_outputs; ++index) {
+        uint32_t g = group[this->entry_id(ready[i], index)];
+        if (!allocated[g] && !persistent[g] &&
+            std::find(seen.begin(), seen.end(), g) == seen.end()) {
+          delta += group_bytes[g];
+          seen.push_back(g);
+        }
+      }
+      for (const auto& e : inode.inputs) {
+        uint32_t eid = this->entry_id(e);
+        uint32_t g = group[eid];
+        if (nodes_[e.node_id].op_type != "null") {
+          recent = std::max(recent, produced[eid] + 1);
+        }
+        uint32_t count = static_cast<uint32_t>(std::count_if(
+            inode.inputs.begin(), inode.inputs.end(),
+            [&](const NodeEntry& x) { return group[this->entry_id(x)] == g; }));
+        if (uses[g] == count && !persistent[g] &&
+            std::find(seen.begin(), seen.end(), g) == seen.end()) {
+          delta -= group_bytes[g];
+          seen.push_back(g);
+        }
+      }
+      if (i == 0 || delta < best_delta ||
+          (delta == best_delta && recent > best_recent) ||
+          (delta == best_delta && recent == best_recent && ready[i] < ready[best])) {
+        best = i;
+        best_delta = delta;
+        best_recent = recent;
+      }
+    }
+    uint32_t nid = ready[best];
+    ready.erase(ready.begin() + best);
+    const auto& inode = nodes_[nid];
+    for (const auto& e : inode.inputs) {
+      --uses[group[this->entry_id(e)]];
+    }
+    for (uint32_t index = 0; index < inode.param.num_outputs; ++index) {
+      uint32_t eid = this->entry_id(nid, index);
+      allocated[group[eid]] = true;
+      produced[eid] = static_cast<uint32_t>(order.size());
+    }
+    order.push_back(nid);
+    for (uint32_t c : consumers[nid]) {
+      if (--num_deps[c] == 0) ready.push_back(c);
+    }
+  }
+  CHECK_EQ(order.size(), this->num_nodes()) << "graph has a cycle";
+  std::pair<size_t, size_t> before = this->EstimateOrder(exec_order_, group);
+  std::pair<size_t, size_t> after = this->EstimateOrder(order, group);
+  bool reordered = after.first <= before.first && order != exec_order_;
+  // the compiled storage plan is only replaced when the order changes.
+  size_t arena_bytes = this->MemoryFootprint();
+  if (reordered) {
+    exec_order_ = order;
+    arena_bytes = this->PlanMemory(alignment);
+  }
+  if (reordered && run_plan_.size() != 0) {
+    this->BuildRunPlan(&run_plan_);
+  }
+  std::ostringstream os;
+  dmlc::JSONWriter writer(&os);
+  writer.BeginObject(false);
+  writer.WriteObjectKeyValue("reordered", static_cast<int>(reordered));
+  writer.WriteObjectKeyValue("peak_bytes_before", before.first);
+  writer.WriteObjectKeyValue("peak_bytes_after", reordered ? after.first : before.first);
+  writer.WriteObjectKeyValue("reuse_distance_before", before.second);
+  writer.WriteObjectKeyValue("reuse_distance_after",
+                             reordered ? after.second : before.second);
+  writer.WriteObjectKeyValue("arena_bytes", arena_bytes);
+  writer.EndObject();
+  return os.str();
+}
+
+void GraphRuntime::SetupGates() {
+  if (attrs_.gate.size() == 0) return;
+  CHECK_EQ(attrs_.gate.size(), nodes_.size())
+      << "gate must have one value per node";
+  is_gate_.resize(this->num_nodes(), false);
+  // Position of each node, a gate must run before the nodes it gates.
+  std::vector<uint32_t> pos(this->num_nodes());
+  for (uint32_t i = 0; i < exec_order_.size(); ++i) pos[exec_order_[i]] = i;
+  for (uint32_t nid = 0; nid < this->num_nodes(); ++nid) {
+    int gate = attrs_.gate[nid];
+    if (gate < 0) continue;
+    CHECK_LT(static_cast<uint32_t>(gate), this->num_nodes());
+    const auto& gnode = nodes_[gate];
+    CHECK(gnode.op_type != "null" && op_execs_[gate])
+        << "gate of node " << nodes_[nid].name << " must be an operator";
+    CHECK(nodes_[nid].op_type != "null")
+        << "input node " << nodes_[nid].name << " cannot be gated";
+    CHECK_LT(pos[gate], pos[nid])
+        << "gate " << gnode.name << " must run before " << nodes_[nid].name;
+    const DLTensor& cond = data_entry_[this->entry_id(gate, 0)];
+    CHECK_EQ(entry_bytes(cond), (cond.dtype.bits * cond.dtype.lanes + 7) / 8U)
+        << "gate " << gnode.name << " must output a scalar";
+    is_gate_[gate] = true;
+  }
+  // A node may only read outputs of nodes behind its own gates,
+  // otherwise it would read stale data when the gate is closed.
+  auto behind = [this](int gate, int other) {
+    for (; gate >= 0; gate = attrs_.gate[gate]) {
+      if (gate == other) return true;
+    }
+    return other < 0;
+  };
+  for (uint32_t nid = 0; nid < this->num_nodes(); ++nid) {
+    if (nodes_[nid].op_type == "null") continue;
+    for (const auto& e : nodes_[nid].inputs) {
+      CHECK(behind(attrs_.gate[nid], attrs_.gate[e.node_id]))
+          << "node " << nodes_[nid].name << " reads " << nodes_[e.node_id].name
+          << " which is behind a gate that does not cover it";
+    }
+  }
+  gate_open_.resize(this->num_nodes(), 0);
+}
+
+bool GraphRuntime::ReadGate(uint32_t nid) {
+  const DLTensor& cond = data_entry_[this->entry_id(nid, 0)];
+  uint8_t bytes[16] = {0};
+  size_t nbytes = entry_bytes(cond);
+  CHECK_LE(nbytes, sizeof(bytes));
+  TVM_CCALL(TVMArrayCopyToBytes(const_cast<DLTensor*>(&cond), bytes, nbytes));
+  if (cond.dtype.code == kDLFloat && cond.dtype.bits == 32) {
+    float v;
+    std::memcpy(&v, bytes, sizeof(v));
+    return v != 0.0f;
+  } else if (cond.dtype.code == kDLFloat && cond.dtype.bits == 64) {
+    double v;
+    std::memcpy(&v, bytes, sizeof(v));
+    return v != 0.0;
+  }
+  for (size_t i = 0; i < nbytes; ++i) {
+    if (bytes[i] != 0) return true;
+  }
+  return false;
+}
+
+bool GraphRuntime::OutputValid(int index) const {
+  CHECK_LT(static_cast<size_t>(index), outputs_.size());
+  if (gate_open_.size() == 0) return true;
+  int gate = attrs_.gate[outputs_[index].node_id];
+  return gate < 0 || gate_open_[gate];
+}
+
+void GraphRuntime::SetOutputCallback(int index, PackedFunc callback) {
+  CHECK_LT(static_cast<size_t>(index), outputs_.size());
+  if (output_callbacks_.size() == 0) {
+    output_callbacks_.resize(outputs_.size());
+    node_outputs_.resize(this->num_nodes());
+    // An output is ready after the node that computes it, __nop nodes
+    // do not run, their outputs are ready with their inputs.
+    for (uint32_t i = 0; i < outputs_.size(); ++i) {
+      uint32_t nid = outputs_[i].node_id;
+      while (nodes_[nid].op_type != "null" && !op_execs_[nid]) {
+        CHECK_EQ(nodes_[nid].inputs.size(), 1U);
+        nid = nodes_[nid].inputs[0].node_id;
+      }
+      if (nodes_[nid].op_type == "null") {
+        input_outputs_.push_back(i);
+      } else {
+        node_outputs_[nid].push_back(i);
+      }
+    }
+  }
+  if (output_callbacks_[index] != nullptr) --num_output_callbacks_;
+  output_callbacks_[index] = callback;
+  if (output_callbacks_[index] != nullptr) ++num_output_callbacks_;
+}
+
+size_t GraphRuntime::BuildRunPlan(std::vector<RunStep>* plan) {
+  PackedFunc faddr_query = module_.GetFunction(
+      symbol::tvm_get_backend_func_addr, false);
+  // nodes that copy inputs across devices keep their closure.
+  std::vector<bool> has_copy(this->num_nodes(), false);
+  for (uint32_t nid = 0; nid < this->num_nodes(); ++nid) {
+    if (!op_execs_[nid]) continue;
+    const OpArgs& op_arg = *op_args_[nid];
+    for (size_t i = 0; i < op_arg.arg_eids.size(); ++i) {
+      if (op_arg.args[i].data != data_entry_[op_arg.arg_eids[i]].data) {
+        has_copy[nid] = true;
+      }
+    }
+  }
+  plan->clear();
+  plan_values_.clear();
+  plan_tcodes_.clear();
+  size_t num_direct = 0;
+  for (uint32_t nid : exec_order_) {
+    if (!op_execs_[nid]) continue;
+    RunStep step;
+    step.faddr = nullptr;
+    step.nid = nid;
+    step.arg_offset = plan_values_.size();
+    step.num_args = 0;
+    if (faddr_query != nullptr && !has_copy[nid]) {
+      void* addr = faddr_query(nodes_[nid].param.func_name);
+      step.faddr = reinterpret_cast<BackendPackedCFunc>(addr);
+    }
+    if (step.faddr != nullptr) {
+      const OpArgs& op_arg = *op_args_[nid];
+      plan_values_.insert(plan_values_.end(),
+                          op_arg.arg_values.begin(), op_arg.arg_values.end());
+      plan_tcodes_.insert(plan_tcodes_.end(),
+                          op_arg.arg_tcodes.begin(), op_arg.arg_tcodes.end());
+      step.num_args = static_cast<int>(op_arg.arg_values.size());
+      ++num_direct;
+    }
+    plan->push_back(step);
+  }
+  return num_direct;
+}
+
+std::string GraphRuntime::CompileRunPlan() {
+  std::vector<RunStep> plan;
+  size_t num_direct = this->BuildRunPlan(&plan);
+  // Run both paths on the current inputs and compare the outputs.
+  auto read_outputs = [this]() {
+    for (const TVMContext& ctx : ctxs_) {
+      DeviceAPI::Get(ctx)->StreamSync(ctx, nullptr);
+    }
+    std::vector<std::vector<uint8_t> > outs(outputs_.size());
+    for (size_t i = 0; i < outputs_.size(); ++i) {
+      DLTensor* t = &data_entry_[this->entry_id(outputs_[i])];
+      outs[i].resize(entry_bytes(*t));
+      TVM_CCALL(TVMArrayCopyToBytes(t, outs[i].data(), outs[i].size()));
+    }
+    return outs;
+  };
+  run_plan_.clear();
+  this->Run();
+  std::vector<std::vector<uint8_t> > expected = read_outputs();
+  run_plan_ = std::move(plan);
+  this->Run();
+  bool validated = read_outputs() == expected;
+  if (!validated) {
+    LOG(WARNING) << "compiled run plan does not match the graph executor, "
+                 << "falling back to the graph executor";
+    run_plan_.clear();
   }
+  std::ostringstream os;
+  dmlc::JSONWriter writer(&os);
+  writer.BeginObject(false);
+  writer.WriteObjectKeyValue("num_steps", run_plan_.size());
+  writer.WriteObjectKeyValue("num_direct", validated ? num_direct : 0);
+  writer.WriteObjectKeyValue("validated", static_cast<int>(validated));
+  writer.EndObject();
+  return os.str();
 }
 
-std::function<void()> GraphRuntime::CreateTVMOp(
+void GraphRuntime::UseSharedArena(Module arena, bool pin) {
+  CHECK(this->CanPlanMemory())
+      << "shared arena requires a single device with addressable memory";
+  CHECK_EQ(arena_depth_, 0) << "cannot change the arena during a run";
+  SharedArena* node = nullptr;
+  if (arena.operator->() != nullptr) {
+    CHECK_EQ(std::string(arena->type_key()), "SharedArena")
+        << "expect a SharedArena module";
+    node = static_cast<SharedArena*>(arena.operator->());
+    CHECK(node->ctx().device_type == ctx_.device_type &&
+          node->ctx().device_id == ctx_.device_id)
+        << "shared arena is on another context";
+  }
+  if (arena_ != nullptr) arena_->Forget(this);
+  shared_arena_ = arena;
+  arena_ = node;
+  pin_arena_ = pin;
+  this->PlanMemory(kAllocAlignment);
+}
+
+void GraphRuntime::InitDeploy(dmlc::Stream* strm,
+                              tvm::runtime::Module module,
+                              const std::vector<TVMContext>& ctxs) {
+  CHECK_NE(ctxs.size(), 0U);
+  uint64_t header, reserved;
+  CHECK(strm->Read(&header) && header == kTVMGraphDeployMagic)
+      << "Invalid deploy artifact format";
+  CHECK(strm->Read(&reserved))
+      << "Invalid deploy artifact format";
+  this->LoadBinary(strm);
+  module_ = module;
+  ctx_ = ctxs[0];
+  ctxs_ = ctxs;
+  std::vector<uint32_t> order;
+  uint64_t arena_bytes;
+  std::vector<int64_t> offsets;
+  uint32_t use_run_plan;
+  CHECK(strm->Read(&order) && strm->Read(&arena_bytes) &&
+        strm->Read(&offsets) && strm->Read(&use_run_plan))
+      << "Invalid deploy artifact format";
+  // Fused shape ops rely on the saved plan to alias their entries.
+  CHECK(arena_bytes == 0 || this->CanPlanMemory())
+      << "deploy artifact with a memory plan needs a single device "
+      << "with addressable memory";
+  if (arena_bytes != 0) {
+    CHECK_EQ(offsets.size(), this->num_node_entries())
+        << "Invalid deploy artifact format";
+    this->SetupEntries();
+    int64_t shape[] = {static_cast<int64_t>(arena_bytes + 3) / 4};
+    DLTensor* arena;
+    TVM_CCALL(TVMArrayAlloc(
+        shape, 1, kDLFloat, 32, 1, ctx_.device_type, ctx_.device_id, &arena));
+    storage_pool_.push_back(arena);
+    for (uint32_t eid = 0; eid < this->num_node_entries(); ++eid) {
+      CHECK(offsets[eid] >= 0 &&
+            static_cast<uint64_t>(offsets[eid]) + data_entry_bytes_[eid] <= arena_bytes)
+          << "Invalid deploy artifact format";
+      data_entry_[eid].data = static_cast<char*>(arena->data) + offsets[eid];
+    }
+  } else {
+    this->SetupStorage();
+  }
+  this->SetupOpExecs();
+  CHECK_EQ(order.size(), this->num_nodes())
+      << "Invalid deploy artifact format";
+  exec_order_ = order;
+  this->SetupGates();
+  this->LoadWarmState(strm);
+  uint64_t num_inputs;
+  CHECK(strm->Read(&num_inputs) && num_inputs == input_nodes_.size())
+      << "Invalid deploy artifact format";
+  std::vector<uint8_t> bytes;
+  for (uint32_t nid : input_nodes_) {
+    uint32_t eid = this->entry_id(nid, 0);
+    uint64_t nbytes;
+    CHECK(strm->Read(&nbytes) && nbytes == data_entry_bytes_[eid])
+        << "Invalid deploy artifact format";
+    // Host entries are read in place.
+    if (data_entry_[eid].ctx.device_type == kDLCPU) {
+      CHECK(strm->Read(data_entry_[eid].data, nbytes) == nbytes)
+          << "Invalid deploy artifact format";
+      continue;
+    }
+    bytes.resize(nbytes);
+    CHECK(strm->Read(bytes.data(), nbytes) == nbytes)
+        << "Invalid deploy artifact format";
+    int64_t shape;
+    DLTensor flat = this->flat_entry(eid, &shape);
+    TVM_CCALL(TVMArrayCopyFromBytes(&flat, bytes.data(), nbytes));
+  }
+  if (use_run_plan != 0) {
+    this->BuildRunPlan(&run_plan_);
+  }
+}
+
+void GraphRuntime::SaveDeploy(dmlc::Stream* strm) {
+  CHECK(arena_ == nullptr)
+      << "detach the shared arena before saving the graph runtime";
+  if (this->CanPlanMemory() && storage_pool_.size() != 1) {
+    this->PlanMemory(kAllocAlignment);
+  }
+  uint64_t header = kTVMGraphDeployMagic, reserved = 0;
+  strm->Write(header);
+  strm->Write(reserved);
+  // Save the symbolic batch dimension rather than the current batch.
+  std::vector<int64_t> batch(batch_entries_.size());
+  for (size_t i = 0; i < batch_entries_.size(); ++i) {
+    batch[i] = attrs_.shape[batch_entries_[i]][0];
+    attrs_.shape[batch_entries_[i]][0] = -1;
+  }
+  this->SaveBinary(strm);
+  for (size_t i = 0; i < batch_entries_.size(); ++i) {
+    attrs_.shape[batch_entries_[i]][0] = batch[i];
+  }
+  strm->Write(exec_order_);
+  uint64_t arena_bytes = 0;
+  std::vector<int64_t> offsets;
+  if (this->CanPlanMemory()) {
+    const DLTensor* arena = storage_pool_[0];
+    arena_bytes = entry_bytes(*arena);
+    for (const DLTensor& t : data_entry_) {
+      offsets.push_back(static_cast<const char*>(t.data) -
+                        static_cast<const char*>(arena->data));
+    }
+  }
+  strm->Write(arena_bytes);
+  strm->Write(offsets);
+  uint32_t use_run_plan = run_plan_.size() != 0;
+  strm->Write(use_run_plan);
+  this->SaveWarmState(strm);
+  uint64_t num_inputs = input_nodes_.size();
+  strm->Write(num_inputs);
+  std::vector<uint8_t> bytes;
+  for (uint32_t nid : input_nodes_) {
+    uint32_t eid = this->entry_id(nid, 0);
+    uint64_t nbytes = data_entry_bytes_[eid];
+    bytes.resize(nbytes);
+    int64_t shape;
+    DLTensor flat = this->flat_entry(eid, &shape);
+    TVM_CCALL(TVMArrayCopyToBytes(&flat, bytes.data(), nbytes));
+    strm->Write(nbytes);
+    strm->Write(bytes.data(), nbytes);
+  }
+}
+
+size_t GraphRuntime::MemoryFootprint() const {
+  size_t total = 0;
+  for (const DLTensor* t : storage_pool_) {
+    total += entry_bytes(*t);
+  }
+  return total;
+}
+
+std::pair<std::function<void()>, std::shared_ptr<GraphRuntime::OpArgs> >
+GraphRuntime::CreateTVMOp(
     const TVMOpParam& param,
     const std::vector<DLTensor>& args,
     size_t num_inputs) {
-  struct OpArgs {
-    std::vector<DLTensor> args;
-    std::vector<TVMValue> arg_values;
-    std::vector<int> arg_tcodes;
-    std::vector<int64_t> shape_data;
-  };
   std::shared_ptr<OpArgs> arg_ptr = std::make_shared<OpArgs>();
   // setup address.
   arg_ptr->args = std::move(args);
@@ -561,7 +2318,7 @@ std::function<void()> GraphRuntime::CreateTVMOp(
     }
   }
   if (param.func_name == "__nop") {
-    return [](){};
+    return {nullptr, arg_ptr};
   }
   // get compiled function from module.
   tvm::runtime::PackedFunc pf = module_.GetFunction(param.func_name, false);
@@ -573,7 +2330,7 @@ std::function<void()> GraphRuntime::CreateTVMOp(
                   static_cast<int>(arg_ptr->arg_values.size()));
     pf.CallPacked(targs, &rv);
   };
-  return fexec;
+  return {fexec, arg_ptr};
 }
 
 PackedFunc GraphRuntime::GetFunction(
@@ -610,26 +2367,184 @@ PackedFunc GraphRuntime::GetFunction(
     return PackedFunc([sptr_to_self, this](TVMArgs args, TVMRetValue* rv) {
         this->LoadParams(args[0].operator std::string());
       });
+  } else if (name == "profile") {
+    return PackedFunc([sptr_to_self, this](TVMArgs args, TVMRetValue* rv) {
+        *rv = this->Profile(args[0], args[1]);
+      });
+  } else if (name == "fuse_shape_ops") {
+    return PackedFunc([sptr_to_self, this](TVMArgs args, TVMRetValue* rv) {
+        *rv = static_cast<int64_t>(this->FuseShapeOps(args[0].operator int()));
+      });
+  } else if (name == "plan_memory") {
+    return PackedFunc([sptr_to_self, this](TVMArgs args, TVMRetValue* rv) {
+        *rv = static_cast<int64_t>(this->PlanMemory(args[0].operator int()));
+      });
+  } else if (name == "use_shared_arena") {
+    return PackedFunc([sptr_to_self, this](TVMArgs args, TVMRetValue* rv) {
+        if (args[0].type_code() == kNull) {
+          this->UseSharedArena(Module(), args[1]);
+        } else if (args[0].type_code() == kModuleHandle) {
+          this->UseSharedArena(args[0], args[1]);
+        } else {
+          // module handle passed over RPC.
+          void* mhandle = args[0];
+          this->UseSharedArena(*static_cast<Module*>(mhandle), args[1]);
+        }
+      });
+  } else if (name == "memory_footprint") {
+    return PackedFunc([sptr_to_self, this](TVMArgs args, TVMRetValue* rv) {
+        *rv = static_cast<int64_t>(this->MemoryFootprint());
+      });
+  } else if (name == "output_valid") {
+    return PackedFunc([sptr_to_self, this](TVMArgs args, TVMRetValue* rv) {
+        *rv = this->OutputValid(args[0]);
+      });
+  } else if (name == "set_output_callback") {
+    return PackedFunc([sptr_to_self, this](TVMArgs args, TVMRetValue* rv) {
+        if (args[1].type_code() == kNull) {
+          this->SetOutputCallback(args[0], PackedFunc());
+        } else {
+          this->SetOutputCallback(args[0], args[1]);
+        }
+      });
+  } else if (name == "set_batch_size") {
+    return PackedFunc([sptr_to_self, this](TVMArgs args, TVMRetValue* rv) {
+        this->SetBatchSize(args[0]);
+      });
+  } else if (name == "optimize_order") {
+    return PackedFunc([sptr_to_self, this](TVMArgs args, TVMRetValue* rv) {
+        *rv = this->OptimizeOrder(args[0].operator int());
+      });
+  } else if (name == "compile_run_plan") {
+    return PackedFunc([sptr_to_self, this](TVMArgs args, TVMRetValue* rv) {
+        *rv = this->CompileRunPlan();
+      });
+  } else if (name == "warmup") {
+    return PackedFunc([sptr_to_self, this](TVMArgs args, TVMRetValue* rv) {
+        *rv = this->Warmup(args[0], args[1]);
+      });
+  } else if (name == "save_deploy") {
+    return PackedFunc([sptr_to_self, this](TVMArgs args, TVMRetValue* rv) {
+        std::string blob;
+        dmlc::MemoryStringStream strm(&blob);
+        this->SaveDeploy(&strm);
+        TVMByteArray arr;
+        arr.data = blob.data();
+        arr.size = blob.length();
+        *rv = arr;
+      });
+  } else if (name == "save_warm_state") {
+    return PackedFunc([sptr_to_self, this](TVMArgs args, TVMRetValue* rv) {
+        std::string blob;
+        dmlc::MemoryStringStream strm(&blob);
+        this->SaveWarmState(&strm);
+        TVMByteArray arr;
+        arr.data = blob.data();
+        arr.size = blob.length();
+        *rv = arr;
+      });
+  } else if (name == "load_warm_state") {
+    return PackedFunc([sptr_to_self, this](TVMArgs args, TVMRetValue* rv) {
+        std::string blob = args[0];
+        dmlc::MemoryStringStream strm(&blob);
+        this->LoadWarmState(&strm);
+      });
   } else {
     return PackedFunc();
   }
 }
 
+/*!
+ * \brief The deploy artifact of a graph runtime.
+ *
+ *  Imported into the library of the operators, the artifact is packed
+ *  into the data section of the exported library with the device code.
+ */
+class GraphDeployModule : public ModuleNode {
+ public:
+  explicit GraphDeployModule(std::string blob)
+      : blob_(blob) {}
+  const char* type_key() const final {
+    return "GraphRuntimeDeploy";
+  }
+  PackedFunc GetFunction(
+      const std::string& name,
+      const std::shared_ptr<ModuleNode>& sptr_to_self) final {
+    return PackedFunc();
+  }
+  void SaveToBinary(dmlc::Stream* stream) final {
+    stream->Write(blob_);
+  }
+  const std::string& blob() const {
+    return blob_;
+  }
+
+ private:
+  std::string blob_;
+};
+
+Module GraphDeployCreate(tvm::runtime::Module m,
+                         const std::vector<TVMContext>& ctxs) {
+  for (const Module& im : m->imports()) {
+    if (std::string(im->type_key()) != "GraphRuntimeDeploy") continue;
+    const std::string& blob =
+        static_cast<const GraphDeployModule*>(im.operator->())->blob();
+    dmlc::MemoryFixedSizeStream strm(const_cast<char*>(blob.data()), blob.size());
+    std::shared_ptr<GraphRuntime> exec = std::make_shared<GraphRuntime>();
+    exec->InitDeploy(&strm, m, ctxs);
+    return Module(exec);
+  }
+  LOG(FATAL) << "Module[" << m->type_key() << "] does not contain a graph runtime";
+  return Module();
+}
+
 Module GraphRuntimeCreate(std::string sym_json,
                           tvm::runtime::Module m,
-                          int device_type,
-                          int device_id) {
-  TVMContext ctx;
-  ctx.device_type = static_cast<DLDeviceType>(device_type);
-  ctx.device_id   = device_id;
+                          const std::vector<TVMContext>& ctxs) {
   std::shared_ptr<GraphRuntime> exec = std::make_shared<GraphRuntime>();
-  exec->Init(sym_json, m, ctx);
+  exec->Init(sym_json, m, ctxs);
   return Module(exec);
 }
 
+// Get the contexts from the (device_type, device_id) pairs in args.
+std::vector<TVMContext> GetAllContext(const TVMArgs& args, int begin) {
+  CHECK_EQ((args.size() - begin) % 2, 0)
+      << "contexts must be given as device_type, device_id pairs";
+  std::vector<TVMContext> ctxs;
+  for (int i = begin; i < args.size(); i += 2) {
+    TVMContext ctx;
+    ctx.device_type = static_cast<DLDeviceType>(args[i].operator int());
+    ctx.device_id = args[i + 1];
+    ctxs.push_back(ctx);
+  }
+  return ctxs;
+}
+
 TVM_REGISTER_GLOBAL("tvm.graph_runtime.create")
 .set_body([](TVMArgs args, TVMRetValue *rv) {
-    *rv = GraphRuntimeCreate(args[0], args[1], args[2], args[3]);
+    *rv = GraphRuntimeCreate(args[0], args[1], GetAllContext(args, 2));
+  });
+
+TVM_REGISTER_GLOBAL("tvm.graph_runtime.shared_arena")
+.set_body([](TVMArgs args, TVMRetValue *rv) {
+    TVMContext ctx;
+    ctx.device_type = static_cast<DLDeviceType>(args[1].operator int());
+    ctx.device_id = args[2];
+    int64_t capacity = args[0];
+    *rv = Module(std::make_shared<SharedArena>(ctx, static_cast<size_t>(capacity)));
+  });
+
+TVM_REGISTER_GLOBAL("tvm.graph_runtime.convert_to_binary")
+.set_body([](TVMArgs args, TVMRetValue *rv) {
+    GraphRuntime graph;
+    graph.LoadGraph(args[0]);
+    std::string blob;
+    dmlc::MemoryStringStream strm(&blob);
+    graph.SaveBinary(&strm);
+    TVMByteArray arr;
+    arr.data = blob.data();
+    arr.size = blob.length();
+    *rv = arr;
   });
 
 TVM_REGISTER_GLOBAL("tvm.graph_runtime.remote_create")
@@ -637,7 +2552,32 @@ TVM_REGISTER_GLOBAL("tvm.graph_runtime.remote_create")
     void* mhandle = args[1];
     *rv = GraphRuntimeCreate(args[0],
                              *static_cast<tvm::runtime::Module*>(mhandle),
-                             args[2], args[3]);
+                             GetAllContext(args, 2));
+  });
+
+TVM_REGISTER_GLOBAL("tvm.graph_runtime.deploy_artifact")
+.set_body([](TVMArgs args, TVMRetValue *rv) {
+    *rv = Module(std::make_shared<GraphDeployModule>(args[0].operator std::string()));
+  });
+
+TVM_REGISTER_GLOBAL("tvm.graph_runtime.create_deploy")
+.set_body([](TVMArgs args, TVMRetValue *rv) {
+    *rv = GraphDeployCreate(args[0], GetAllContext(args, 1));
+  });
+
+TVM_REGISTER_GLOBAL("tvm.graph_runtime.remote_create_deploy")
+.set_body([](TVMArgs args, TVMRetValue *rv) {
+    void* mhandle = args[0];
+    *rv = GraphDeployCreate(*static_cast<tvm::runtime::Module*>(mhandle),
+                            GetAllContext(args, 1));
+  });
+
+TVM_REGISTER_GLOBAL("module.loadbinary_GraphRuntimeDeploy")
+.set_body([](TVMArgs args, TVMRetValue *rv) {
+    dmlc::Stream* stream = static_cast<dmlc::Stream*>(args[0].operator void*());
+    std::string blob;
+    CHECK(stream->Read(&blob)) << "Invalid deploy artifact format";
+    *rv = Module(std::make_shared<GraphDeployModule>(blob));
   });
 }  // namespace runtime
 }  // namespace tvm
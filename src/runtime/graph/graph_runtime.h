@@ -17,6 +17,19 @@ namespace runtime {
 constexpr uint64_t kTVMNDArrayMagic = 0xDD5E40F096B4A13F;
 /*! \brief Magic number for NDArray list file  */
 constexpr uint64_t kTVMNDArrayListMagic = 0xF7E58D4F05049CB7;
+/*!
+ * \brief Magic number for quantized NDArray file.
+ *
+ *  The record stores int8 or float16 data followed by per-channel
+ *  float32 scales, it is expanded to the graph's dtype at load time.
+ */
+constexpr uint64_t kTVMQuantizedNDArrayMagic = 0x3C7A96E1D05F42B8;
+/*! \brief Magic number for binary graph file */
+constexpr uint64_t kTVMGraphBinaryMagic = 0xA9C15E3F7B2D4086;
+/*! \brief Magic number for graph runtime warm state file */
+constexpr uint64_t kTVMGraphWarmStateMagic = 0x58E2D7136AC4B09F;
+/*! \brief Magic number for graph runtime deploy artifact */
+constexpr uint64_t kTVMGraphDeployMagic = 0x9A4F1C62E7D3B805;
 
 /*! \brief operator attributes about tvm op */
 struct TVMOpParam {
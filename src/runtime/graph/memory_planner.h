@@ -0,0 +1,98 @@
+/*!
+ *  Copyright (c) 2018 by Contributors
+ * \file memory_planner.h
+ * \brief Static offset planner for the activation memory of graph runtime.
+ */
+#ifndef TVM_RUNTIME_GRAPH_MEMORY_PLANNER_H_
+#define TVM_RUNTIME_GRAPH_MEMORY_PLANNER_H_
+
+#include <dmlc/logging.h>
+#include <algorithm>
+#include <vector>
+
+namespace tvm {
+namespace runtime {
+
+/*!
+ * \brief A buffer to be placed in the arena.
+ *
+ *  The buffer is live in the closed interval [start, end]
+ *  of the execution steps. The output of a step therefore always
+ *  overlaps with the inputs that die in it and never takes their place:
+ *  in-place reuse is left out on purpose, since the runtime has no way
+ *  to tell which kernels are safe to run with aliased arguments.
+ */
+struct PlannedBuffer {
+  /*! \brief number of bytes of the buffer */
+  size_t size{0};
+  /*! \brief first step in which the buffer is live */
+  uint32_t start{0};
+  /*! \brief last step in which the buffer is live */
+  uint32_t end{0};
+  /*! \brief the planned byte offset in the arena */
+  size_t offset{0};
+};
+
+/*!
+ * \brief Assign arena offsets to buffers.
+ *
+ *  Buffers are placed greedily in decreasing order of size. Each buffer
+ *  takes the smallest gap that fits it among the buffers already placed
+ *  whose lifetime overlaps with it, or goes after all of them.
+ *
+ * \param buffers The buffers, offset is filled by the planner.
+ * \param alignment The alignment of every offset.
+ * \return The total number of bytes of the arena.
+ */
+inline size_t PlanMemoryOffsets(std::vector<PlannedBuffer>* buffers,
+                                size_t alignment) {
+  CHECK_GT(alignment, 0U);
+  auto align = [alignment](size_t n) {
+    return (n + alignment - 1) / alignment * alignment;
+  };
+  std::vector<size_t> order(buffers->size());
+  for (size_t i = 0; i < order.size(); ++i) order[i] = i;
+  std::stable_sort(order.begin(), order.end(), [buffers](size_t a, size_t b) {
+      return (*buffers)[a].size > (*buffers)[b].size;
+    });
+  std::vector<size_t> placed;
+  size_t total = 0;
+  for (size_t idx : order) {
+    PlannedBuffer& buf = (*buffers)[idx];
+    size_t size = align(buf.size);
+    // placed buffers that are live at the same time, by offset.
+    std::vector<size_t> conflicts;
+    for (size_t j : placed) {
+      const PlannedBuffer& other = (*buffers)[j];
+      if (other.start <= buf.end && buf.start <= other.end) {
+        conflicts.push_back(j);
+      }
+    }
+    std::sort(conflicts.begin(), conflicts.end(), [buffers](size_t a, size_t b) {
+        return (*buffers)[a].offset < (*buffers)[b].offset;
+      });
+    size_t prev_end = 0;
+    size_t best_offset = 0, best_gap = 0;
+    bool found = false;
+    for (size_t j : conflicts) {
+      const PlannedBuffer& other = (*buffers)[j];
+      if (other.offset >= prev_end) {
+        size_t gap = other.offset - prev_end;
+        if (gap >= size && (!found || gap < best_gap)) {
+          best_offset = prev_end;
+          best_gap = gap;
+          found = true;
+        }
+      }
+      prev_end = std::max(prev_end, align(other.offset + other.size));
+    }
+    buf.offset = found ? best_offset : prev_end;
+    total = std::max(total, buf.offset + size);
+    placed.push_back(idx);
+  }
+  return total;
+}
+
+}  // namespace runtime
+}  // namespace tvm
+#endif  // TVM_RUNTIME_GRAPH_MEMORY_PLANNER_H_
@@ -0,0 +1,233 @@
+/*!
+ *  Copyright (c) 2018 by Contributors
+ * \file shared_arena.h
+ * \brief Activation memory shared by the graph runtimes of one process.
+ */
+#ifndef TVM_RUNTIME_GRAPH_SHARED_ARENA_H_
+#define TVM_RUNTIME_GRAPH_SHARED_ARENA_H_
+
+#include <tvm/runtime/packed_func.h>
+#include <tvm/runtime/device_api.h>
+#include <dmlc/json.h>
+#include <dmlc/logging.h>
+#include <condition_variable>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace tvm {
+namespace runtime {
+
+/*!
+ * \brief A bounded pool of activation blocks leased by graph runtimes.
+ *
+ *  A runtime leases one block at the start of a run and releases it at
+ *  the end. A pinned runtime keeps its block after the release, so the
+ *  next run takes it back without rebinding the operator arguments.
+ *  Kept blocks are evicted in least recently used order when a lease
+ *  needs memory. A lease waits when all the memory is leased.
+ */
+class SharedArena : public ModuleNode {
+ public:
+  /*!
+   * \param ctx The context of the blocks.
+   * \param capacity The maximum number of bytes allocated at a time.
+   */
+  SharedArena(TVMContext ctx, size_t capacity)
+      : ctx_(ctx), capacity_(capacity) {
+    CHECK_GT(capacity, 0U) << "capacity of the shared arena must be positive";
+  }
+  ~SharedArena() {
+    for (const Block& b : blocks_) {
+      DeviceAPI::Get(ctx_)->FreeDataSpace(ctx_, b.data);
+    }
+  }
+  const char* type_key() const final {
+    return "SharedArena";
+  }
+  PackedFunc GetFunction(
+      const std::string& name,
+      const std::shared_ptr<ModuleNode>& sptr_to_self) final {
+    if (name == "stats") {
+      return PackedFunc([sptr_to_self, this](TVMArgs args, TVMRetValue* rv) {
+          *rv = this->Stats();
+        });
+    }
+    return PackedFunc();
+  }
+  /*! \return The context of the blocks. */
+  TVMContext ctx() const {
+    return ctx_;
+  }
+  /*!
+   * \brief Lease a block of at least nbytes.
+   *  The block kept by the owner from its last run is preferred, then
+   *  the smallest free block that fits, then a new block within the
+   *  capacity, then the least recently used block kept by another owner.
+   * \param owner The leasing runtime.
+   * \param nbytes The number of bytes needed.
+   * \return The data of the block.
+   */
+  void* Lease(const void* owner, size_t nbytes) {
+    CHECK_LE(nbytes, capacity_)
+        << "activations of " << nbytes << " bytes exceed the shared arena of "
+        << capacity_ << " bytes";
+    std::unique_lock<std::mutex> lock(mutex_);
+    ++num_leases_;
+    bool waited = false;
+    while (true) {
+      Block* best = nullptr;
+      for (Block& b : blocks_) {
+        if (b.owner != owner || b.leased) continue;
+        if (b.nbytes >= nbytes) {
+          best = &b;
+          ++num_hits_;
+        } else {
+          // the plan of the owner grew, give the old block back.
+          b.owner = nullptr;
+        }
+        break;
+      }
+      for (Block& b : blocks_) {
+        if (best != nullptr) break;
+        if (b.owner == nullptr && !b.leased && b.nbytes >= nbytes &&
+            (best == nullptr || b.nbytes < best->nbytes)) {
+          best = &b;
+        }
+      }
+      if (best == nullptr && allocated_ + nbytes > capacity_) {
+        // take over the least recently used kept block that fits.
+        for (Block& b : blocks_) {
+          if (b.owner == nullptr || b.leased || b.nbytes < nbytes) continue;
+          if (best == nullptr || b.last_use < best->last_use) best = &b;
+        }
+        if (best != nullptr) ++num_evictions_;
+      }
+      if (best == nullptr && this->Reserve(nbytes)) {
+        Block b;
+        TVMType type_hint{kDLUInt, 8, 1};
+        b.data = DeviceAPI::Get(ctx_)->AllocDataSpace(
+            ctx_, nbytes, kAllocAlignment, type_hint);
+        b.nbytes = nbytes;
+        allocated_ += nbytes;
+        ++num_allocs_;
+        blocks_.push_back(b);
+        best = &blocks_.back();
+      }
+      if (best != nullptr) {
+        best->owner = owner;
+        best->leased = true;
+        return best->data;
+      }
+      if (!waited) ++num_waits_;
+      waited = true;
+      cv_.wait(lock);
+    }
+  }
+  /*!
+   * \brief Release the block leased by owner.
+   * \param owner The leasing runtime.
+   * \param pin Whether the owner keeps the block for its next run.
+   */
+  void Release(const void* owner, bool pin) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      for (Block& b : blocks_) {
+        if (b.owner != owner || !b.leased) continue;
+        b.leased = false;
+        b.last_use = ++clock_;
+        if (!pin) b.owner = nullptr;
+      }
+    }
+    cv_.notify_all();
+  }
+  /*!
+   * \brief Give back the blocks kept by a runtime that goes away.
+   * \param owner The runtime.
+   */
+  void Forget(const void* owner) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      for (Block& b : blocks_) {
+        if (b.owner != owner) continue;
+        b.owner = nullptr;
+        b.leased = false;
+      }
+    }
+    cv_.notify_all();
+  }
+  /*! \return The counters of the arena in json. */
+  std::string Stats() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::ostringstream os;
+    dmlc::JSONWriter writer(&os);
+    writer.BeginObject(false);
+    writer.WriteObjectKeyValue("capacity_bytes", capacity_);
+    writer.WriteObjectKeyValue("allocated_bytes", allocated_);
+    writer.WriteObjectKeyValue("num_blocks", blocks_.size());
+    writer.WriteObjectKeyValue("num_leases", num_leases_);
+    writer.WriteObjectKeyValue("num_hits", num_hits_);
+    writer.WriteObjectKeyValue("num_allocs", num_allocs_);
+    writer.WriteObjectKeyValue("num_evictions", num_evictions_);
+    writer.WriteObjectKeyValue("num_waits", num_waits_);
+    writer.EndObject();
+    return os.str();
+  }
+
+ private:
+  // A block of device memory.
+  struct Block {
+    void* data{nullptr};
+    size_t nbytes{0};
+    // the runtime that leases or keeps the block, nullptr if free.
+    const void* owner{nullptr};
+    bool leased{false};
+    // release time, for the LRU eviction.
+    uint64_t last_use{0};
+  };
+  // Free idle blocks until nbytes more fit in the capacity,
+  // free blocks go first, then the least recently used kept blocks.
+  bool Reserve(size_t nbytes) {
+    size_t idle = 0;
+    for (const Block& b : blocks_) {
+      if (!b.leased) idle += b.nbytes;
+    }
+    if (allocated_ - idle + nbytes > capacity_) return false;
+    while (allocated_ + nbytes > capacity_) {
+      size_t victim = blocks_.size();
+      for (size_t i = 0; i < blocks_.size(); ++i) {
+        const Block& b = blocks_[i];
+        if (b.leased) continue;
+        if (victim == blocks_.size() ||
+            (b.owner == nullptr) > (blocks_[victim].owner == nullptr) ||
+            ((b.owner == nullptr) == (blocks_[victim].owner == nullptr) &&
+             b.last_use < blocks_[victim].last_use)) {
+          victim = i;
+        }
+      }
+      CHECK_LT(victim, blocks_.size());
+      if (blocks_[victim].owner != nullptr) ++num_evictions_;
+      DeviceAPI::Get(ctx_)->FreeDataSpace(ctx_, blocks_[victim].data);
+      allocated_ -= blocks_[victim].nbytes;
+      blocks_.erase(blocks_.begin() + victim);
+    }
+    return true;
+  }
+  TVMContext ctx_;
+  size_t capacity_;
+  size_t allocated_{0};
+  std::vector<Block> blocks_;
+  uint64_t clock_{0};
+  size_t num_leases_{0};
+  size_t num_hits_{0};
+  size_t num_allocs_{0};
+  size_t num_evictions_{0};
+  size_t num_waits_{0};
+  std::mutex mutex_;
+  std::condition_variable cv_;
+};
+
+}  // namespace runtime
+}  // namespace tvm
+#endif  // TVM_RUNTIME_GRAPH_SHARED_ARENA_H_
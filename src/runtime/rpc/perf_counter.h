@@ -0,0 +1,181 @@
+/*!
+ *  Copyright (c) 2018 by Contributors
+ * \file perf_counter.h
+ * \brief Hardware performance counters of the time evaluator.
+ */
+#ifndef TVM_RUNTIME_RPC_PERF_COUNTER_H_
+#define TVM_RUNTIME_RPC_PERF_COUNTER_H_
+
+#include <dmlc/logging.h>
+#include <cstdint>
+#include <limits>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#ifdef __linux__
+#include <dirent.h>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#endif
+
+namespace tvm {
+namespace runtime {
+
+/*!
+ * \brief A set of hardware counters summed over the threads of the process.
+ *
+ *  Counters are opened on every thread alive at creation, which covers
+ *  the thread pool once it has started, and inherited by new threads.
+ *  A counter the system refuses, e.g. when perf_event_paranoid forbids
+ *  it or outside of Linux, reads as NaN.
+ */
+class PerfCounters {
+ public:
+  /*!
+   * \param names Comma separated names: cycles, instructions,
+   *  cache-references, cache-misses, branches and branch-misses,
+   *  or the software counters task-clock (ns) and page-faults.
+   */
+  explicit PerfCounters(const std::string& names) {
+    std::istringstream is(names);
+    std::string name;
+    while (std::getline(is, name, ',')) {
+      if (name.empty()) continue;
+      Counter c;
+      c.name = name;
+      ConfigOf(name, &c);
+      counters_.push_back(c);
+    }
+#ifdef __linux__
+    std::vector<int> tids = Threads();
+    for (Counter& c : counters_) {
+      for (int tid : tids) {
+        int fd = Open(c.type, c.config, tid);
+        if (fd != -1) c.fds.push_back(fd);
+      }
+      if (c.fds.empty()) {
+        LOG(WARNING) << "cannot open perf counter " << c.name << ": " << strerror(errno);
+      }
+    }
+#endif
+  }
+  ~PerfCounters() {
+#ifdef __linux__
+    for (Counter& c : counters_) {
+      for (int fd : c.fds) close(fd);
+    }
+#endif
+  }
+  /*! \return The number of counters. */
+  size_t size() const {
+    return counters_.size();
+  }
+  /*! \brief Reset and start the counters. */
+  void Start() {
+#ifdef __linux__
+    for (Counter& c : counters_) {
+      for (int fd : c.fds) {
+        ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+      }
+    }
+#endif
+  }
+  /*!
+   * \brief Stop the counters.
+   * \return The counts since Start, scaled up when the
+   *  kernel multiplexed the counters.
+   */
+  std::vector<double> Stop() {
+    std::vector<double> values(counters_.size(), std::numeric_limits<double>::quiet_NaN());
+#ifdef __linux__
+    for (Counter& c : counters_) {
+      for (int fd : c.fds) ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+    }
+    for (size_t i = 0; i < counters_.size(); ++i) {
+      if (counters_[i].fds.empty()) continue;
+      double total = 0;
+      for (int fd : counters_[i].fds) {
+        // value, time enabled, time running.
+        uint64_t data[3];
+        if (read(fd, data, sizeof(data)) != sizeof(data)) continue;
+        if (data[2] != 0) {
+          total += static_cast<double>(data[0]) * data[1] / data[2];
+        }
+      }
+      values[i] = total;
+    }
+#endif
+    return values;
+  }
+
+ private:
+  struct Counter {
+    std::string name;
+    uint32_t type;
+    uint64_t config;
+    std::vector<int> fds;
+  };
+  static void ConfigOf(const std::string& name, Counter* c) {
+    const char* kNames[] = {"cycles", "instructions", "cache-references",
+                            "cache-misses", "branches", "branch-misses",
+                            "task-clock", "page-faults"};
+#ifdef __linux__
+    const uint32_t kTypes[] = {
+      PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE,
+      PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE,
+      PERF_TYPE_SOFTWARE, PERF_TYPE_SOFTWARE};
+    const uint64_t kConfigs[] = {
+      PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+      PERF_COUNT_HW_CACHE_REFERENCES, PERF_COUNT_HW_CACHE_MISSES,
+      PERF_COUNT_HW_BRANCH_INSTRUCTIONS, PERF_COUNT_HW_BRANCH_MISSES,
+      PERF_COUNT_SW_TASK_CLOCK, PERF_COUNT_SW_PAGE_FAULTS};
+#endif
+    for (size_t i = 0; i < sizeof(kNames) / sizeof(kNames[0]); ++i) {
+      if (name != kNames[i]) continue;
+#ifdef __linux__
+      c->type = kTypes[i];
+      c->config = kConfigs[i];
+#endif
+      return;
+    }
+    LOG(FATAL) << "unknown perf counter " << name;
+  }
+#ifdef __linux__
+  static std::vector<int> Threads() {
+    std::vector<int> tids;
+    if (DIR* dir = opendir("/proc/self/task")) {
+      while (dirent* ent = readdir(dir)) {
+        if (ent->d_name[0] != '.') tids.push_back(atoi(ent->d_name));
+      }
+      closedir(dir);
+    }
+    if (tids.empty()) tids.push_back(0);
+    return tids;
+  }
+  static int Open(uint32_t type, uint64_t config, int tid) {
+    perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.disabled = 1;
+    attr.inherit = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    return static_cast<int>(syscall(SYS_perf_event_open, &attr, tid, -1, -1, 0));
+  }
+#endif
+  std::vector<Counter> counters_;
+};
+
+}  // namespace runtime
+}  // namespace tvm
+#endif  // TVM_RUNTIME_RPC_PERF_COUNTER_H_
@@ -0,0 +1,159 @@
+/*!
+ *  Copyright (c) 2018 by Contributors
+ * \file rpc_codec.h
+ * \brief Compression of bulk RPC payloads.
+ */
+#ifndef TVM_RUNTIME_RPC_RPC_CODEC_H_
+#define TVM_RUNTIME_RPC_RPC_CODEC_H_
+
+#include <dmlc/logging.h>
+#include <cstring>
+#include <memory>
+#include <string>
+
+namespace tvm {
+namespace runtime {
+
+/*! \brief The codecs of RPC payloads. */
+enum RPCCodec : int {
+  kRPCCodecNone = 0,
+  kRPCCodecBytePlaneRLE = 1,
+};
+
+/*! \brief The element width of the byte planes, the width of float32. */
+constexpr size_t kBytePlaneWidth = 4;
+
+/*!
+ * \brief Run length encode one byte plane.
+ *  A control byte c < 128 is followed by c + 1 literal bytes,
+ *  c >= 128 by one byte repeated c - 125 times.
+ * \param in The plane.
+ * \param size The size of the plane.
+ * \param out The output, with room for size bytes.
+ * \return The number of bytes written, or size when RLE does not pay off.
+ */
+inline size_t RLEEncodePlane(const unsigned char* in, size_t size, unsigned char* out) {
+  // give up on planes that do not shrink in their first bytes.
+  const size_t kProbeBytes = 4096;
+  size_t i = 0, nout = 0;
+  while (i < size) {
+    size_t run = 1;
+    while (i + run < size && run < 130 && in[i + run] == in[i]) ++run;
+    if (run >= 3) {
+      if (nout + 2 >= size) return size;
+      out[nout++] = static_cast<unsigned char>(run + 125);
+      out[nout++] = in[i];
+      i += run;
+      continue;
+    }
+    // literals until the next run of three.
+    size_t begin = i;
+    while (i < size && i - begin < 128 &&
+           !(i + 2 < size && in[i] == in[i + 1] && in[i] == in[i + 2])) {
+      ++i;
+    }
+    size_t n = i - begin;
+    if (nout + 1 + n >= size) return size;
+    out[nout++] = static_cast<unsigned char>(n - 1);
+    std::memcpy(out + nout, in + begin, n);
+    nout += n;
+    if (i >= kProbeBytes && i - begin == 128 && nout >= i) return size;
+  }
+  return nout;
+}
+
+/*!
+ * \brief Compress a payload with the byte plane + RLE codec.
+ *
+ *  The bytes are first regrouped by their position in each 4-byte
+ *  element, so that the sign and exponent bytes of a float tensor
+ *  sit together, and the trailing bytes form a fifth plane. Each plane
+ *  starts with a mode byte, 1 for a run length encoded plane and 0 for
+ *  a plane stored as it is.
+ *
+ * \param data The payload.
+ * \param size The size of the payload.
+ * \param out The compressed bytes.
+ * \return Whether the payload shrinks by at least 1/16, not worth
+ *   decoding otherwise.
+ */
+inline bool BytePlaneRLEEncode(const char* data, size_t size, std::string* out) {
+  const unsigned char* in = reinterpret_cast<const unsigned char*>(data);
+  size_t nelem = size / kBytePlaneWidth;
+  std::unique_ptr<unsigned char[]> planes(new unsigned char[size]);
+  for (size_t i = 0; i < nelem; ++i) {
+    for (size_t p = 0; p < kBytePlaneWidth; ++p) {
+      planes[p * nelem + i] = in[i * kBytePlaneWidth + p];
+    }
+  }
+  std::memcpy(planes.get() + nelem * kBytePlaneWidth,
+              in + nelem * kBytePlaneWidth, size - nelem * kBytePlaneWidth);
+  out->resize(size + kBytePlaneWidth + 1);
+  unsigned char* dst = reinterpret_cast<unsigned char*>(&(*out)[0]);
+  size_t nout = 0;
+  for (size_t p = 0; p <= kBytePlaneWidth; ++p) {
+    const unsigned char* plane = planes.get() + p * nelem;
+    size_t plane_size = p < kBytePlaneWidth ? nelem : size - nelem * kBytePlaneWidth;
+    size_t n = RLEEncodePlane(plane, plane_size, dst + nout + 1);
+    dst[nout++] = n < plane_size ? 1 : 0;
+    if (n == plane_size) std::memcpy(dst + nout, plane, plane_size);
+    nout += n;
+  }
+  out->resize(nout);
+  return nout < size - size / 16;
+}
+
+/*!
+ * \brief Decompress a payload of the byte plane + RLE codec.
+ * \param in The compressed bytes.
+ * \param in_size The number of compressed bytes.
+ * \param data The payload to fill.
+ * \param size The size of the payload.
+ */
+inline void BytePlaneRLEDecode(const char* in, size_t in_size, char* data, size_t size) {
+  const unsigned char* src = reinterpret_cast<const unsigned char*>(in);
+  size_t nelem = size / kBytePlaneWidth;
+  std::unique_ptr<unsigned char[]> planes(new unsigned char[size]);
+  size_t pos = 0;
+  for (size_t p = 0; p <= kBytePlaneWidth; ++p) {
+    unsigned char* plane = planes.get() + p * nelem;
+    size_t plane_size = p < kBytePlaneWidth ? nelem : size - nelem * kBytePlaneWidth;
+    CHECK_LT(pos, in_size) << "corrupted RPC payload";
+    if (src[pos++] == 0) {
+      CHECK_LE(pos + plane_size, in_size) << "corrupted RPC payload";
+      std::memcpy(plane, src + pos, plane_size);
+      pos += plane_size;
+      continue;
+    }
+    size_t nout = 0;
+    while (nout < plane_size) {
+      CHECK_LT(pos, in_size) << "corrupted RPC payload";
+      size_t c = src[pos++];
+      if (c < 128) {
+        size_t n = c + 1;
+        CHECK(pos + n <= in_size && nout + n <= plane_size) << "corrupted RPC payload";
+        std::memcpy(plane + nout, src + pos, n);
+        pos += n;
+        nout += n;
+      } else {
+        size_t n = c - 125;
+        CHECK(pos < in_size && nout + n <= plane_size) << "corrupted RPC payload";
+        std::memset(plane + nout, src[pos++], n);
+        nout += n;
+      }
+    }
+  }
+  CHECK_EQ(pos, in_size) << "corrupted RPC payload";
+  unsigned char* out = reinterpret_cast<unsigned char*>(data);
+  for (size_t i = 0; i < nelem; ++i) {
+    for (size_t p = 0; p < kBytePlaneWidth; ++p) {
+      out[i * kBytePlaneWidth + p] = planes[p * nelem + i];
+    }
+  }
+  std::memcpy(out + nelem * kBytePlaneWidth, planes.get() + nelem * kBytePlaneWidth,
+              size - nelem * kBytePlaneWidth);
+}
+
+}  // namespace runtime
+}  // namespace tvm
+#endif  // TVM_RUNTIME_RPC_RPC_CODEC_H_
@@ -25,6 +25,16 @@ struct RPCWrappedFunc {
   void operator()(TVMArgs args, TVMRetValue *rv) const {
     sess_->CallFunc(handle_, args, rv, &fwrap_);
   }
+  // Send the call and return the future of its result.
+  PackedFunc CallAsync(TVMArgs args) const {
+    return MakeFuture(sess_, sess_->AsyncCallFunc(handle_, args, fwrap_));
+  }
+  /*!
+   * \brief Make the future of an asynchronous request.
+   *  future(True) waits for the reply and returns the result,
+   *  future(False) returns whether the reply has arrived.
+   */
+  static PackedFunc MakeFuture(std::shared_ptr<RPCSession> sess, uint64_t seq);
   ~RPCWrappedFunc() {
     sess_->CallRemote(RPCCode::kFreeFunc, handle_);
   }
@@ -75,13 +85,27 @@ class RPCModuleNode final : public ModuleNode {
     return sess_;
   }
 
+  PackedFunc GetAsyncFunction(const std::string& name) {
+    RPCFuncHandle handle = GetFuncHandle(name);
+    if (handle == nullptr) return PackedFunc();
+    auto wf = std::make_shared<RPCWrappedFunc>(handle, sess_);
+    return PackedFunc([wf](TVMArgs args, TVMRetValue* rv) {
+        *rv = wf->CallAsync(args);
+      });
+  }
+
   PackedFunc GetTimeEvaluator(const std::string& name,
                               TVMContext ctx,
                               int number,
-                              int repeat) {
+                              int repeat,
+                              int max_repeat,
+                              double rel_ci,
+                              int64_t flush_cache_bytes,
+                              const std::string& counters) {
     RPCFuncHandle handle = GetFuncHandle(name);
     if (handle == nullptr) return PackedFunc();
-    handle = sess_->GetTimeEvaluator(handle, ctx, number, repeat);
+    handle = sess_->GetTimeEvaluator(
+        handle, ctx, number, repeat, max_repeat, rel_ci, flush_cache_bytes, counters);
     return WrapRemote(handle);
   }
 
@@ -134,6 +158,34 @@ void RPCWrappedFunc::WrapRemote(std::shared_ptr<RPCSession> sess,
   }
 }
 
+PackedFunc RPCWrappedFunc::MakeFuture(std::shared_ptr<RPCSession> sess,
+                                      uint64_t seq) {
+  // Drops the reply when the future goes away without waiting.
+  struct Request {
+    std::shared_ptr<RPCSession> sess;
+    uint64_t seq;
+    bool waited{false};
+    ~Request() {
+      if (!waited) sess->Discard(seq);
+    }
+  };
+  auto req = std::make_shared<Request>();
+  req->sess = sess;
+  req->seq = seq;
+  return PackedFunc([req](TVMArgs args, TVMRetValue* rv) {
+      bool wait = args.size() == 0 || args[0].operator bool();
+      if (req->waited) {
+        CHECK(!wait) << "the result of the request has been taken";
+        *rv = true;
+      } else if (wait) {
+        req->waited = true;
+        req->sess->Wait(req->seq, rv);
+      } else {
+        *rv = req->sess->IsDone(req->seq);
+      }
+    });
+}
+
 Module CreateRPCModule(std::shared_ptr<RPCSession> sess) {
   std::shared_ptr<RPCModuleNode> n =
       std::make_shared<RPCModuleNode>(nullptr, sess);
@@ -147,13 +199,65 @@ TVM_REGISTER_GLOBAL("module._RPCTimeEvaluator")
     TVMContext ctx;
     ctx.device_type = static_cast<DLDeviceType>(args[2].operator int());
     ctx.device_id = args[3];
+    int max_repeat = args.size() > 6 ? args[6].operator int() : 0;
+    double rel_ci = args.size() > 7 ? args[7].operator double() : 0;
+    int64_t flush_cache_bytes = args.size() > 8 ? args[8].operator int64_t() : 0;
+    std::string counters = args.size() > 9 ? args[9].operator std::string() : "";
     if (tkey == "rpc") {
       *rv = static_cast<RPCModuleNode*>(m.operator->())
-          ->GetTimeEvaluator(args[1], ctx, args[4], args[5]);
+          ->GetTimeEvaluator(args[1], ctx, args[4], args[5],
+                             max_repeat, rel_ci, flush_cache_bytes, counters);
     } else {
       *rv = WrapTimeEvaluator(
-          m.GetFunction(args[1], false), ctx, args[4], args[5]);
+          m.GetFunction(args[1], false), ctx, args[4], args[5],
+          max_repeat, rel_ci, flush_cache_bytes, counters);
+    }
+  });
+
+TVM_REGISTER_GLOBAL("contrib.rpc._AsyncFunction")
+.set_body([](TVMArgs args, TVMRetValue* rv) {
+    Module m = args[0];
+    std::string tkey = m->type_key();
+    CHECK_EQ(tkey, "rpc");
+    std::string name = args[1];
+    PackedFunc f = static_cast<RPCModuleNode*>(m.operator->())->GetAsyncFunction(name);
+    CHECK(f != nullptr) << "Cannot find remote function " << name;
+    *rv = f;
+  });
+
+TVM_REGISTER_GLOBAL("contrib.rpc._AsyncCopy")
+.set_body([](TVMArgs args, TVMRetValue* rv) {
+    DLTensor* from = args[0];
+    DLTensor* to = args[1];
+    auto nbytes = [](const DLTensor* arr) {
+      size_t size = 1;
+      for (int i = 0; i < arr->ndim; ++i) {
+        size *= static_cast<size_t>(arr->shape[i]);
+      }
+      return size * ((arr->dtype.bits * arr->dtype.lanes + 7) / 8);
+    };
+    size_t size = nbytes(from);
+    CHECK_EQ(size, nbytes(to)) << "copy between arrays of different sizes";
+    int from_dev_type = from->ctx.device_type;
+    int to_dev_type = to->ctx.device_type;
+    bool download = from_dev_type > kRPCSessMask && to_dev_type == kDLCPU;
+    CHECK(download || (from_dev_type == kDLCPU && to_dev_type > kRPCSessMask))
+        << "expect copy between a local cpu array and a remote array";
+    int dev_type = download ? from_dev_type : to_dev_type;
+    std::shared_ptr<RPCSession> sess = RPCSession::Get(dev_type / kRPCSessMask - 1);
+    CHECK(sess != nullptr) << "the remote session has been closed";
+    uint64_t seq;
+    if (download) {
+      seq = sess->AsyncCopyFromRemote(
+          static_cast<const RemoteSpace*>(from->data)->data, from->byte_offset,
+          to->data, to->byte_offset, size, from->ctx);
+    } else {
+      seq = sess->AsyncCopyToRemote(
+          from->data, from->byte_offset,
+          static_cast<const RemoteSpace*>(to->data)->data, to->byte_offset,
+          size, to->ctx);
     }
+    *rv = RPCWrappedFunc::MakeFuture(sess, seq);
   });
 
 TVM_REGISTER_GLOBAL("contrib.rpc._LoadRemoteModule")
@@ -191,6 +295,37 @@ TVM_REGISTER_GLOBAL("contrib.rpc._ModuleHandle")
     *rv = static_cast<RPCModuleNode*>(m.operator->())->module_handle();
   });
 
+TVM_REGISTER_GLOBAL("contrib.rpc._SetChunkSize")
+.set_body([](TVMArgs args, TVMRetValue* rv) {
+    Module m = args[0];
+    std::string tkey = m->type_key();
+    CHECK_EQ(tkey, "rpc");
+    int64_t chunk_size = args[1];
+    CHECK_GE(chunk_size, 0) << "chunk size must not be negative";
+    static_cast<RPCModuleNode*>(m.operator->())->sess()->set_chunk_size(
+        static_cast<size_t>(chunk_size));
+  });
+
+TVM_REGISTER_GLOBAL("contrib.rpc._SetCompression")
+.set_body([](TVMArgs args, TVMRetValue* rv) {
+    Module m = args[0];
+    std::string tkey = m->type_key();
+    CHECK_EQ(tkey, "rpc");
+    int64_t threshold = args[2];
+    CHECK_GE(threshold, 0) << "threshold must not be negative";
+    *rv = static_cast<RPCModuleNode*>(m.operator->())->sess()->SetCompression(
+        args[1], static_cast<size_t>(threshold));
+  });
+
+TVM_REGISTER_GLOBAL("contrib.rpc._NewSession")
+.set_body([](TVMArgs args, TVMRetValue* rv) {
+    Module m = args[0];
+    std::string tkey = m->type_key();
+    CHECK_EQ(tkey, "rpc");
+    *rv = CreateRPCModule(
+        static_cast<RPCModuleNode*>(m.operator->())->sess()->NewSession());
+  });
+
 TVM_REGISTER_GLOBAL("contrib.rpc._SessTableIndex")
 .set_body([](TVMArgs args, TVMRetValue* rv) {
     Module m = args[0];
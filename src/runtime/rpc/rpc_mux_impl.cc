@@ -0,0 +1,270 @@
+/*!
+ *  Copyright (c) 2018 by Contributors
+ * \file rpc_mux_impl.cc
+ * \brief Several RPC sessions multiplexed over one connection.
+ */
+#include <dmlc/logging.h>
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+#include "./rpc_session.h"
+
+namespace tvm {
+namespace runtime {
+
+/*!
+ * \brief The header of a frame of the connection, followed by size
+ *  bytes of the session id. An empty frame closes the session.
+ */
+struct MuxFrameHeader {
+  uint32_t id;
+  uint32_t size;
+};
+
+/*!
+ * \brief The shared connection of the multiplexed sessions.
+ *
+ *  Frames are sent whole under a lock, so the sessions interleave at
+ *  frame boundaries. There is no dedicated reader thread: a session
+ *  that waits for its bytes reads frames of the connection while no
+ *  other session does, and queues the frames of the other sessions.
+ *  The server always has a session accepting, so it keeps draining
+ *  the connection while its sessions are busy.
+ */
+class RPCMux : public std::enable_shared_from_this<RPCMux> {
+ public:
+  RPCMux(std::unique_ptr<RPCChannel> channel, bool is_server)
+      : channel_(std::move(channel)), is_server_(is_server) {}
+  // Client: open a new session.
+  std::unique_ptr<RPCChannel> Open();
+  // Server: wait for a session opened by the client, nullptr once the connection closes.
+  std::unique_ptr<RPCChannel> Accept();
+  void Send(uint32_t id, const void* data, size_t size) {
+    std::lock_guard<std::mutex> lock(send_mutex_);
+    MuxFrameHeader header{id, static_cast<uint32_t>(size)};
+    send_buf_.resize(sizeof(header) + size);
+    std::memcpy(&send_buf_[0], &header, sizeof(header));
+    if (size != 0) std::memcpy(&send_buf_[sizeof(header)], data, size);
+    size_t sent = 0;
+    while (sent < send_buf_.size()) {
+      size_t n = channel_->Send(&send_buf_[sent], send_buf_.size() - sent);
+      CHECK_NE(n, 0U) << "RPC connection closed";
+      sent += n;
+    }
+  }
+  size_t Recv(uint32_t id, void* data, size_t size) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+      Stream& st = streams_[id];
+      if (st.pos < st.buf.size()) {
+        size_t n = std::min(size, st.buf.size() - st.pos);
+        std::memcpy(data, &st.buf[st.pos], n);
+        st.pos += n;
+        return n;
+      }
+      if (st.closed || eof_) return 0;
+      if (!reading_) {
+        size_t n = this->ReadFrame(&lock, id, data, size);
+        if (n != 0) return n;
+      } else {
+        cv_.wait(lock);
+      }
+    }
+  }
+  void Close(uint32_t id) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      auto it = streams_.find(id);
+      // remember the id until the close frame of the peer arrives.
+      if (it == streams_.end() || !it->second.closed) closed_ids_.insert(id);
+      if (it != streams_.end()) streams_.erase(it);
+    }
+    try {
+      this->Send(id, nullptr, 0);
+    } catch (const dmlc::Error& e) {
+      // the connection is already gone.
+    }
+  }
+
+ private:
+  // The received bytes of a session.
+  struct Stream {
+    std::string buf;
+    size_t pos{0};
+    bool closed{false};
+  };
+  bool RecvAll(void* data, size_t size) {
+    char* ptr = static_cast<char*>(data);
+    while (size != 0) {
+      size_t n = channel_->Recv(ptr, size);
+      if (n == 0) return false;
+      ptr += n;
+      size -= n;
+    }
+    return true;
+  }
+  // Read one frame as the reader of the connection, with the lock
+  // released meanwhile. Return the bytes received straight into data
+  // when the frame belongs to session id.
+  size_t ReadFrame(std::unique_lock<std::mutex>* lock,
+                   uint32_t id, void* data, size_t size) {
+    reading_ = true;
+    lock->unlock();
+    MuxFrameHeader header;
+    size_t direct = 0;
+    std::string rest;
+    bool ok = false;
+    try {
+      ok = this->RecvAll(&header, sizeof(header));
+      if (ok && header.id == id && data != nullptr) {
+        direct = std::min(size, static_cast<size_t>(header.size));
+        ok = this->RecvAll(data, direct);
+      }
+      rest.resize(ok ? header.size - direct : 0);
+      ok = ok && this->RecvAll(&rest[0], rest.size());
+    } catch (const dmlc::Error& e) {
+      // a reset connection ends the sessions like a closed one,
+      // the peer resets it when it exits with frames unread.
+      ok = false;
+    }
+    lock->lock();
+    reading_ = false;
+    cv_.notify_all();
+    if (!ok) {
+      eof_ = true;
+      return 0;
+    }
+    auto it = streams_.find(header.id);
+    if (it == streams_.end()) {
+      // frames of a session closed on this side are dropped, the
+      // sessions of the client do not start in the order of their ids.
+      auto closed = closed_ids_.find(header.id);
+      if (closed != closed_ids_.end()) {
+        // the close frame is the last frame of the peer.
+        if (header.size == 0) closed_ids_.erase(closed);
+        return 0;
+      }
+      if (!is_server_) return 0;
+      accept_queue_.push_back(header.id);
+      it = streams_.emplace(header.id, Stream()).first;
+    }
+    Stream& st = it->second;
+    if (header.size == 0) {
+      st.closed = true;
+    } else if (!rest.empty()) {
+      st.buf.erase(0, st.pos);
+      st.pos = 0;
+      st.buf.append(rest);
+    }
+    return direct;
+  }
+
+  std::unique_ptr<RPCChannel> channel_;
+  bool is_server_;
+  std::mutex send_mutex_;
+  std::vector<char> send_buf_;
+  // guards the fields below.
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::map<uint32_t, Stream> streams_;
+  bool reading_{false};
+  bool eof_{false};
+  uint32_t next_id_{1};
+  std::set<uint32_t> closed_ids_;
+  std::vector<uint32_t> accept_queue_;
+};
+
+class MuxChannel final : public RPCChannel {
+ public:
+  MuxChannel(std::shared_ptr<RPCMux> mux, uint32_t id)
+      : mux_(mux), id_(id) {}
+  ~MuxChannel() {
+    mux_->Close(id_);
+  }
+  size_t Send(const void* data, size_t size) final {
+    size_t n = std::min(size, kMaxFrameBytes);
+    mux_->Send(id_, data, n);
+    return n;
+  }
+  size_t Recv(void* data, size_t size) final {
+    return mux_->Recv(id_, data, size);
+  }
+  std::unique_ptr<RPCChannel> OpenSibling() final {
+    return mux_->Open();
+  }
+
+ private:
+  // Bounds how long one session holds the connection.
+  static constexpr size_t kMaxFrameBytes = 64 << 10;
+  std::shared_ptr<RPCMux> mux_;
+  uint32_t id_;
+};
+
+constexpr size_t MuxChannel::kMaxFrameBytes;
+
+std::unique_ptr<RPCChannel> RPCMux::Open() {
+  CHECK(!is_server_) << "only the client opens multiplexed sessions";
+  std::lock_guard<std::mutex> lock(mutex_);
+  uint32_t id = next_id_++;
+  streams_[id];
+  return std::unique_ptr<RPCChannel>(new MuxChannel(shared_from_this(), id));
+}
+
+std::unique_ptr<RPCChannel> RPCMux::Accept() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (accept_queue_.empty() && !eof_) {
+    if (!reading_) {
+      this->ReadFrame(&lock, 0, nullptr, 0);
+    } else {
+      cv_.wait(lock);
+    }
+  }
+  if (accept_queue_.empty()) return nullptr;
+  uint32_t id = accept_queue_.front();
+  accept_queue_.erase(accept_queue_.begin());
+  return std::unique_ptr<RPCChannel>(new MuxChannel(shared_from_this(), id));
+}
+
+std::unique_ptr<RPCChannel> CreateMuxChannel(std::unique_ptr<RPCChannel> channel) {
+  return std::make_shared<RPCMux>(std::move(channel), false)->Open();
+}
+
+void RPCMuxServerLoop(std::unique_ptr<RPCChannel> channel) {
+  std::shared_ptr<RPCMux> mux = std::make_shared<RPCMux>(std::move(channel), true);
+  // Session threads are detached so that finished ones go away at once,
+  // the loop only waits for the running ones when the connection ends.
+  struct Running {
+    std::mutex mutex;
+    std::condition_variable cv;
+    int count{0};
+  };
+  std::shared_ptr<Running> running = std::make_shared<Running>();
+  while (std::unique_ptr<RPCChannel> session = mux->Accept()) {
+    RPCChannel* ptr = session.release();
+    {
+      std::lock_guard<std::mutex> lock(running->mutex);
+      ++running->count;
+    }
+    std::thread([ptr, running]() {
+        try {
+          RPCSession::Create(std::unique_ptr<RPCChannel>(ptr), "MuxServerLoop")->ServerLoop();
+        } catch (const dmlc::Error& e) {
+          LOG(WARNING) << "RPC session ends with error: " << e.what();
+        }
+        std::lock_guard<std::mutex> lock(running->mutex);
+        if (--running->count == 0) running->cv.notify_all();
+      }).detach();
+  }
+  std::unique_lock<std::mutex> lock(running->mutex);
+  running->cv.wait(lock, [&running]() { return running->count == 0; });
+}
+
+}  // namespace runtime
+}  // namespace tvm
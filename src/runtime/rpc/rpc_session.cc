@@ -6,11 +6,17 @@
 #include <tvm/runtime/packed_func.h>
 #include <tvm/runtime/device_api.h>
 #include <tvm/runtime/registry.h>
+#include <algorithm>
 #include <memory>
 #include <array>
 #include <string>
 #include <chrono>
+#include <cmath>
+#include <numeric>
+#include <vector>
 #include "./rpc_session.h"
+#include "./rpc_codec.h"
+#include "./perf_counter.h"
 #include "../../common/ring_buffer.h"
 
 namespace tvm {
@@ -69,6 +75,56 @@ class RPCSession::EventHandler {
   void FinishCopyAck() {
     this->SwitchToState(kRecvCode);
   }
+  // The memory that the pending bulk payload goes to, nullptr if the
+  // handler does not wait for a payload. The bytes of the payload
+  // already in the reader are counted in size.
+  char* PayloadTarget(size_t* size) {
+    if (payload_target_ == nullptr || payload_received_) return nullptr;
+    if (payload_stage_ == kPayloadRaw) {
+      *size = payload_size_;
+      return payload_target_;
+    } else if (payload_stage_ == kPayloadWire) {
+      *size = temp_wire_.size();
+      return dmlc::BeginPtr(temp_wire_);
+    }
+    return nullptr;
+  }
+  // The payload has been received into PayloadTarget by the caller,
+  // including the bytes that were in the reader.
+  void FinishPayload() {
+    pending_request_bytes_ = 0;
+    payload_received_ = true;
+  }
+  // Use codec for the payloads of at least threshold bytes.
+  void SetCompression(int codec, size_t threshold) {
+    codec_ = codec;
+    compress_threshold_ = threshold;
+  }
+  // Whether a payload of size bytes is sent with its wire size.
+  bool Compressed(size_t size) const {
+    return codec_ != kRPCCodecNone && size >= compress_threshold_;
+  }
+  // Decompress the wire bytes of a payload.
+  void DecodePayload(const char* wire, size_t wire_size, char* data, size_t size) {
+    CHECK_EQ(codec_, kRPCCodecBytePlaneRLE);
+    BytePlaneRLEDecode(wire, wire_size, data, size);
+  }
+  // Write a bulk payload, compressed when the session enables it.
+  // A compressed payload starts with its wire size, equal to the size
+  // when the codec does not pay off and the bytes are sent as they are.
+  void WritePayload(const void* data, size_t size) {
+    if (!Compressed(size)) {
+      writer_->Write(data, size);
+      return;
+    }
+    uint64_t wire_size = size;
+    if (BytePlaneRLEEncode(static_cast<const char*>(data), size, &temp_wire_)) {
+      wire_size = temp_wire_.size();
+      data = temp_wire_.data();
+    }
+    writer_->Write(&wire_size, sizeof(wire_size));
+    writer_->Write(data, wire_size);
+  }
   RPCCode HandleNextEvent(TVMRetValue* rv,
                           bool client_mode,
                           const PackedFunc* fwrap) {
@@ -144,6 +200,8 @@ class RPCSession::EventHandler {
     pending_request_bytes_ = sizeof(RPCCode);
     arg_recv_stage_ = 0;
     arg_buf_.reset();
+    payload_target_ = nullptr;
+    payload_received_ = false;
   }
   // strip session on mask
   TVMContext StripSessMask(TVMContext ctx) {
@@ -203,14 +261,14 @@ class RPCSession::EventHandler {
           const char* s = value.v_str;
           uint64_t len = strlen(s);
           writer_->Write(&len, sizeof(len));
-          writer_->Write(s, sizeof(char) * len);
+          WritePayload(s, sizeof(char) * len);
           break;
         }
         case kBytes: {
           TVMByteArray* bytes = static_cast<TVMByteArray*>(arg_values[i].v_handle);
           uint64_t len = bytes->size;
           writer_->Write(&len, sizeof(len));
-          writer_->Write(bytes->data, sizeof(char) * len);
+          WritePayload(bytes->data, sizeof(char) * len);
           break;
         }
         default: {
@@ -259,6 +317,25 @@ class RPCSession::EventHandler {
   // Temp variables for copy request state.
   TVMContext copy_ctx_;
   uint64_t copy_handle_, copy_offset_, copy_size_;
+  // Where the payload of kCopyToRemote lands.
+  char* copy_target_{nullptr};
+  // The stages of receiving a payload.
+  enum PayloadStage {
+    kPayloadWireSize,
+    kPayloadRaw,
+    kPayloadWire
+  };
+  // The payload being received, see ExpectPayload.
+  PayloadStage payload_stage_{kPayloadRaw};
+  char* payload_target_{nullptr};
+  size_t payload_size_{0};
+  // Whether the payload was received without the reader.
+  bool payload_received_{false};
+  // Compressed bytes of a payload.
+  std::string temp_wire_;
+  // Codec of the payloads of at least compress_threshold_ bytes.
+  int codec_{kRPCCodecNone};
+  size_t compress_threshold_{0};
   // State switcher
   void SwitchToState(State state) {
     // invariant
@@ -386,7 +463,7 @@ class RPCSession::EventHandler {
           temp_bytes_.reset( new RPCByteArrayBuffer());
           temp_bytes_->data.resize(len);
           arg_recv_stage_ = 1;
-          this->RequestBytes(len);
+          this->ExpectPayload(dmlc::BeginPtr(temp_bytes_->data), len);
           break;
         break;
       }
@@ -415,9 +492,7 @@ class RPCSession::EventHandler {
     } else {
       CHECK_EQ(arg_recv_stage_, 1);
       if (tcode == kStr || tcode == kBytes) {
-        if (temp_bytes_->data.size() != 0) {
-          this->Read(&(temp_bytes_->data[0]), temp_bytes_->data.size());
-        }
+        if (!this->RecvPayload()) return;
         if (tcode == kStr) {
           value.v_str = temp_bytes_->data.c_str();
         } else {
@@ -487,7 +562,7 @@ class RPCSession::EventHandler {
     if (ctx.device_type == kDLCPU) {
       RPCCode code = RPCCode::kCopyAck;
       writer_->Write(&code, sizeof(code));
-      writer_->Write(reinterpret_cast<char*>(handle) + offset, size);
+      WritePayload(reinterpret_cast<char*>(handle) + offset, size);
     } else {
       temp_data_.resize(size + 1);
       try {
@@ -500,7 +575,7 @@ class RPCSession::EventHandler {
             size, ctx, cpu_ctx, nullptr);
         RPCCode code = RPCCode::kCopyAck;
         writer_->Write(&code, sizeof(code));
-        writer_->Write(&temp_data_[0], size);
+        WritePayload(&temp_data_[0], size);
       } catch (const std::runtime_error &e) {
         RPCCode code = RPCCode::kException;
         writer_->Write(&code, sizeof(code));
@@ -522,21 +597,22 @@ class RPCSession::EventHandler {
       this->Read(&copy_size_, sizeof(uint64_t));
       this->Read(&copy_ctx_, sizeof(TVMContext));
       arg_recv_stage_ = 1;
-      CHECK_EQ(pending_request_bytes_, 0U);
-      this->RequestBytes(copy_size_);
+      if (copy_ctx_.device_type == kDLCPU) {
+        copy_target_ = reinterpret_cast<char*>(copy_handle_) + copy_offset_;
+      } else {
+        temp_data_.resize(copy_size_ + 1);
+        copy_target_ = &temp_data_[0];
+      }
+      this->ExpectPayload(copy_target_, copy_size_);
     } else {
       CHECK_EQ(arg_recv_stage_, 1);
+      if (!this->RecvPayload()) return;
       TVMValue ret_value;
       ret_value.v_handle = nullptr;
       int ret_tcode = kNull;
       RPCCode code = RPCCode::kReturn;
       std::string errmsg;
-      if (copy_ctx_.device_type == kDLCPU) {
-        this->Read(
-            reinterpret_cast<char*>(copy_handle_) + copy_offset_, copy_size_);
-      } else {
-        temp_data_.resize(copy_size_ + 1);
-        this->Read(&temp_data_[0], copy_size_);
+      if (copy_ctx_.device_type != kDLCPU) {
         try {
           TVMContext cpu_ctx;
           cpu_ctx.device_type = kDLCPU;
@@ -614,6 +690,55 @@ class RPCSession::EventHandler {
     reader_->Read(data, size);
     pending_request_bytes_ -= size;
   }
+  // Start receiving a payload of size bytes into target. The reader
+  // does not grow for it, the session receives it in place when it
+  // can, see PayloadTarget.
+  void ExpectPayload(char* target, size_t size) {
+    CHECK_EQ(pending_request_bytes_, 0U);
+    payload_target_ = target;
+    payload_size_ = size;
+    payload_received_ = false;
+    if (Compressed(size)) {
+      payload_stage_ = kPayloadWireSize;
+      this->RequestBytes(sizeof(uint64_t));
+    } else {
+      payload_stage_ = kPayloadRaw;
+      pending_request_bytes_ = size;
+    }
+  }
+  // Advance the payload when the requested bytes are ready,
+  // return whether the whole payload is in its target.
+  bool RecvPayload() {
+    switch (payload_stage_) {
+      case kPayloadWireSize: {
+        uint64_t wire_size;
+        this->Read(&wire_size, sizeof(wire_size));
+        if (wire_size == payload_size_) {
+          payload_stage_ = kPayloadRaw;
+        } else {
+          temp_wire_.resize(wire_size);
+          payload_stage_ = kPayloadWire;
+        }
+        pending_request_bytes_ = wire_size;
+        return false;
+      }
+      case kPayloadRaw: {
+        if (!payload_received_) this->Read(payload_target_, payload_size_);
+        break;
+      }
+      case kPayloadWire: {
+        if (!payload_received_) {
+          this->Read(dmlc::BeginPtr(temp_wire_), temp_wire_.size());
+        }
+        DecodePayload(temp_wire_.data(), temp_wire_.size(),
+                      payload_target_, payload_size_);
+        break;
+      }
+    }
+    payload_target_ = nullptr;
+    payload_received_ = false;
+    return true;
+  }
   // Request number of bytes from reader.
   void RequestBytes(size_t nbytes) {
     pending_request_bytes_ += nbytes;
@@ -679,6 +804,12 @@ RPCCode RPCSession::HandleUntilReturnEvent(
           return channel_->Send(data, size);
         }, writer_.bytes_available());
     }
+    size_t payload_size;
+    char* payload = handler_->PayloadTarget(&payload_size);
+    if (payload != nullptr) {
+      this->RecvPayload(payload, payload_size);
+      handler_->FinishPayload();
+    }
     size_t bytes_needed = handler_->BytesNeeded();
     if (bytes_needed != 0) {
       size_t n = reader_.WriteWithCallback([this](void* data, size_t size) {
@@ -697,14 +828,133 @@ RPCCode RPCSession::HandleUntilReturnEvent(
   return code;
 }
 
+void RPCSession::FlushWriter() {
+  while (writer_.bytes_available() != 0) {
+    writer_.ReadWithCallback([this](const void *data, size_t size) {
+        return channel_->Send(data, size);
+      }, writer_.bytes_available());
+  }
+}
+
+void RPCSession::RecvPayload(char* data, size_t size) {
+  size_t nread = std::min(reader_.bytes_available(), size);
+  reader_.Read(data, nread);
+  data += nread;
+  size -= nread;
+  while (size != 0) {
+    // Receive the rest in place, the bytes after it go to the reader.
+    reader_.WriteWithCallback([this, &data, &size](void* ahead, size_t ahead_size) {
+        if (size == 0) return static_cast<size_t>(0);
+        void* bufs[2] = {data, ahead};
+        size_t sizes[2] = {size, ahead_size};
+        size_t n = channel_->RecvV(bufs, sizes, 2);
+        CHECK_NE(n, 0U) << "Channel closes before we get neded bytes";
+        size_t ndata = std::min(n, size);
+        data += ndata;
+        size -= ndata;
+        return n - ndata;
+      }, reader_.capacity());
+  }
+}
+
+void RPCSession::WaitWindow(size_t nbytes) {
+  // Bound the requests and the reply payloads in flight, so that the
+  // server never blocks on sending replies while we block on sending
+  // requests.
+  const uint64_t kMaxInflightRequests = 64;
+  const size_t kMaxInflightBytes = 256 << 10;
+  while (recv_seq_ != next_seq_ &&
+         (next_seq_ - recv_seq_ >= kMaxInflightRequests ||
+          inflight_bytes_ + nbytes > kMaxInflightBytes)) {
+    this->RecvReply();
+  }
+}
+
+uint64_t RPCSession::AddPending(PendingRequest req) {
+  uint64_t seq = next_seq_++;
+  inflight_bytes_ += req.nbytes;
+  pending_[seq] = std::move(req);
+  this->FlushWriter();
+  return seq;
+}
+
+void RPCSession::RecvReply() {
+  CHECK_LT(recv_seq_, next_seq_) << "no request in flight";
+  uint64_t seq = recv_seq_++;
+  PendingRequest& req = pending_.at(seq);
+  try {
+    RPCCode code = HandleUntilReturnEvent(
+        &req.rv, true, req.fwrap != nullptr ? &req.fwrap : nullptr);
+    CHECK(code == req.reply) << "code=" << static_cast<int>(code);
+    if (code == RPCCode::kCopyAck) {
+      uint64_t wire_size = req.copy_size;
+      if (handler_->Compressed(req.copy_size)) {
+        this->RecvPayload(reinterpret_cast<char*>(&wire_size), sizeof(wire_size));
+      }
+      if (wire_size == req.copy_size) {
+        this->RecvPayload(req.copy_to, req.copy_size);
+      } else {
+        std::string wire(wire_size, '\0');
+        this->RecvPayload(dmlc::BeginPtr(wire), wire_size);
+        handler_->DecodePayload(wire.data(), wire_size, req.copy_to, req.copy_size);
+      }
+      handler_->FinishCopyAck();
+    }
+  } catch (const dmlc::Error& e) {
+    // keep the first error of a chain of chunks.
+    if (req.error.length() == 0) req.error = e.what();
+  }
+  req.done = true;
+  inflight_bytes_ -= req.nbytes;
+  if (req.chain_to != 0) {
+    // the next chunk finishes the copy and carries its error.
+    PendingRequest& next = pending_.at(req.chain_to);
+    if (next.error.length() == 0) next.error = req.error;
+    pending_.erase(seq);
+  } else if (req.discarded) {
+    pending_.erase(seq);
+  }
+}
+
+void RPCSession::Wait(uint64_t seq, TVMRetValue* rv) {
+  std::lock_guard<std::recursive_mutex> lock(mutex_);
+  auto it = pending_.find(seq);
+  CHECK(it != pending_.end()) << "unknown or finished request " << seq;
+  while (!it->second.done) {
+    this->RecvReply();
+  }
+  PendingRequest req = std::move(it->second);
+  pending_.erase(it);
+  if (req.error.length() != 0) {
+    throw dmlc::Error(req.error);
+  }
+  *rv = std::move(req.rv);
+}
+
+bool RPCSession::IsDone(uint64_t seq) {
+  std::lock_guard<std::recursive_mutex> lock(mutex_);
+  auto it = pending_.find(seq);
+  return it == pending_.end() || it->second.done;
+}
+
+void RPCSession::Discard(uint64_t seq) {
+  std::lock_guard<std::recursive_mutex> lock(mutex_);
+  auto it = pending_.find(seq);
+  if (it == pending_.end()) return;
+  if (it->second.done) {
+    pending_.erase(it);
+  } else {
+    it->second.discarded = true;
+  }
+}
+
 void RPCSession::Init() {
   // Event handler
   handler_ = std::make_shared<EventHandler>(&reader_, &writer_, table_index_, name_);
   // Quick function to call remote.
   call_remote_ = PackedFunc([this](TVMArgs args, TVMRetValue* rv) {
       handler_->SendPackedSeq(args.values, args.type_codes, args.num_args);
-      RPCCode code = HandleUntilReturnEvent(rv, true, nullptr);
-      CHECK(code == RPCCode::kReturn) << "code=" << static_cast<int>(code);
+      this->Wait(this->AddPending(PendingRequest()), rv);
     });
 }
 
@@ -718,6 +968,15 @@ std::shared_ptr<RPCSession> RPCSession::Create(
   return sess;
 }
 
+std::shared_ptr<RPCSession> RPCSession::NewSession() {
+  std::lock_guard<std::recursive_mutex> lock(mutex_);
+  CHECK(channel_ != nullptr) << "RPC session " << name_ << " is closed";
+  std::unique_ptr<RPCChannel> channel = channel_->OpenSibling();
+  CHECK(channel != nullptr)
+      << "RPC session " << name_ << " is not multiplexed, connect with multiplex=True";
+  return RPCSession::Create(std::move(channel), name_);
+}
+
 std::shared_ptr<RPCSession> RPCSession::Get(int table_index) {
   return RPCSessTable::Global()->Get(table_index);
 }
@@ -780,13 +1039,8 @@ void RPCSession::CallFunc(void* h,
                           TVMRetValue* rv,
                           const PackedFunc* fwrap) {
   std::lock_guard<std::recursive_mutex> lock(mutex_);
-  RPCCode code = RPCCode::kCallFunc;
-  writer_.Write(&code, sizeof(code));
-  uint64_t handle = reinterpret_cast<uint64_t>(h);
-  writer_.Write(&handle, sizeof(handle));
-  handler_->SendPackedSeq(args.values, args.type_codes, args.num_args);
-  code = HandleUntilReturnEvent(rv, true, fwrap);
-  CHECK(code == RPCCode::kReturn) << "code=" << static_cast<int>(code);
+  PackedFunc f = fwrap != nullptr ? *fwrap : PackedFunc();
+  this->Wait(this->AsyncCallFunc(h, args, f), rv);
 }
 
 void RPCSession::CopyToRemote(void* from,
@@ -796,19 +1050,9 @@ void RPCSession::CopyToRemote(void* from,
                               size_t data_size,
                               TVMContext ctx_to) {
   std::lock_guard<std::recursive_mutex> lock(mutex_);
-  ctx_to = handler_->StripSessMask(ctx_to);
-  RPCCode code = RPCCode::kCopyToRemote;
-  writer_.Write(&code, sizeof(code));
-  uint64_t handle = reinterpret_cast<uint64_t>(to);
-  writer_.Write(&handle, sizeof(handle));
-  uint64_t offset = static_cast<uint64_t>(to_offset);
-  writer_.Write(&offset, sizeof(offset));
-  uint64_t size = static_cast<uint64_t>(data_size);
-  writer_.Write(&size, sizeof(size));
-  writer_.Write(&ctx_to, sizeof(ctx_to));
-  writer_.Write(reinterpret_cast<char*>(from) + from_offset, data_size);
   TVMRetValue rv;
-  CHECK(HandleUntilReturnEvent(&rv, true, nullptr) == RPCCode::kReturn);
+  this->Wait(this->AsyncCopyToRemote(
+      from, from_offset, to, to_offset, data_size, ctx_to), &rv);
 }
 
 void RPCSession::CopyFromRemote(void* from,
@@ -818,35 +1062,132 @@ void RPCSession::CopyFromRemote(void* from,
                                 size_t data_size,
                                 TVMContext ctx_from) {
   std::lock_guard<std::recursive_mutex> lock(mutex_);
-  ctx_from = handler_->StripSessMask(ctx_from);
-  RPCCode code = RPCCode::kCopyFromRemote;
+  TVMRetValue rv;
+  this->Wait(this->AsyncCopyFromRemote(
+      from, from_offset, to, to_offset, data_size, ctx_from), &rv);
+}
+
+uint64_t RPCSession::AsyncCallFunc(void* h,
+                                   TVMArgs args,
+                                   const PackedFunc& fwrap) {
+  std::lock_guard<std::recursive_mutex> lock(mutex_);
+  this->WaitWindow(0);
+  RPCCode code = RPCCode::kCallFunc;
   writer_.Write(&code, sizeof(code));
-  uint64_t handle = reinterpret_cast<uint64_t>(from);
+  uint64_t handle = reinterpret_cast<uint64_t>(h);
   writer_.Write(&handle, sizeof(handle));
-  uint64_t offset = static_cast<uint64_t>(from_offset);
+  handler_->SendPackedSeq(args.values, args.type_codes, args.num_args);
+  PendingRequest req;
+  req.fwrap = fwrap;
+  return this->AddPending(std::move(req));
+}
+
+void RPCSession::WriteCopyHeader(RPCCode code,
+                                 void* remote,
+                                 size_t remote_offset,
+                                 size_t data_size,
+                                 TVMContext ctx) {
+  writer_.Write(&code, sizeof(code));
+  uint64_t handle = reinterpret_cast<uint64_t>(remote);
+  writer_.Write(&handle, sizeof(handle));
+  uint64_t offset = static_cast<uint64_t>(remote_offset);
   writer_.Write(&offset, sizeof(offset));
   uint64_t size = static_cast<uint64_t>(data_size);
   writer_.Write(&size, sizeof(size));
-  writer_.Write(&ctx_from, sizeof(ctx_from));
-  TVMRetValue rv;
-  CHECK(HandleUntilReturnEvent(&rv, true, nullptr) == RPCCode::kCopyAck);
-  reader_.Reserve(data_size);
-  while (reader_.bytes_available() < data_size) {
-    size_t bytes_needed = data_size - reader_.bytes_available();
-    reader_.WriteWithCallback([this](void* data, size_t size) {
-        size_t n = channel_->Recv(data, size);
-        CHECK_NE(n, 0U) << "Channel closes before we get neded bytes";
-        return n;
-      }, bytes_needed);
+  writer_.Write(&ctx, sizeof(ctx));
+}
+
+void RPCSession::ChainChunk(uint64_t prev, PendingRequest* req) {
+  auto it = pending_.find(prev);
+  CHECK(it != pending_.end());
+  if (it->second.done) {
+    req->error = it->second.error;
+    pending_.erase(it);
+  } else {
+    it->second.chain_to = next_seq_;
   }
-  reader_.Read(reinterpret_cast<char*>(to) + to_offset, data_size);
-  handler_->FinishCopyAck();
+}
+
+uint64_t RPCSession::AsyncCopyToRemote(void* from,
+                                       size_t from_offset,
+                                       void* to,
+                                       size_t to_offset,
+                                       size_t data_size,
+                                       TVMContext ctx_to) {
+  std::lock_guard<std::recursive_mutex> lock(mutex_);
+  ctx_to = handler_->StripSessMask(ctx_to);
+  // Send one request per chunk, the last one stands for the copy.
+  uint64_t seq = 0;
+  size_t begin = 0;
+  do {
+    size_t nbytes = data_size - begin;
+    if (chunk_size_ != 0) nbytes = std::min(nbytes, chunk_size_);
+    this->WaitWindow(0);
+    PendingRequest req;
+    if (begin != 0) this->ChainChunk(seq, &req);
+    this->WriteCopyHeader(RPCCode::kCopyToRemote,
+                          to, to_offset + begin, nbytes, ctx_to);
+    handler_->WritePayload(reinterpret_cast<char*>(from) + from_offset + begin, nbytes);
+    seq = this->AddPending(std::move(req));
+    begin += nbytes;
+  } while (begin != data_size);
+  return seq;
+}
+
+uint64_t RPCSession::AsyncCopyFromRemote(void* from,
+                                         size_t from_offset,
+                                         void* to,
+                                         size_t to_offset,
+                                         size_t data_size,
+                                         TVMContext ctx_from) {
+  std::lock_guard<std::recursive_mutex> lock(mutex_);
+  ctx_from = handler_->StripSessMask(ctx_from);
+  uint64_t seq = 0;
+  size_t begin = 0;
+  do {
+    size_t nbytes = data_size - begin;
+    if (chunk_size_ != 0) nbytes = std::min(nbytes, chunk_size_);
+    this->WaitWindow(nbytes);
+    PendingRequest req;
+    if (begin != 0) this->ChainChunk(seq, &req);
+    this->WriteCopyHeader(RPCCode::kCopyFromRemote,
+                          from, from_offset + begin, nbytes, ctx_from);
+    req.reply = RPCCode::kCopyAck;
+    req.copy_to = reinterpret_cast<char*>(to) + to_offset + begin;
+    req.copy_size = nbytes;
+    req.nbytes = nbytes;
+    seq = this->AddPending(std::move(req));
+    begin += nbytes;
+  } while (begin != data_size);
+  return seq;
+}
+
+int RPCSession::SetCompression(int codec, size_t threshold) {
+  std::lock_guard<std::recursive_mutex> lock(mutex_);
+  // Servers older than the codecs abort on kSetCompression,
+  // only send it to servers that register the compression marker.
+  void* marker = this->CallRemote(
+      RPCCode::kGetGlobalFunc, std::string(kRPCCompressionMarker));
+  if (marker == nullptr) return kRPCCodecNone;
+  this->CallRemote(RPCCode::kFreeFunc, marker);
+  int accepted = this->CallRemote(
+      RPCCode::kSetCompression, codec, static_cast<uint64_t>(threshold));
+  handler_->SetCompression(accepted, threshold);
+  return accepted;
+}
+
+void RPCSession::set_chunk_size(size_t chunk_size) {
+  std::lock_guard<std::recursive_mutex> lock(mutex_);
+  chunk_size_ = chunk_size;
 }
 
 RPCFuncHandle RPCSession::GetTimeEvaluator(
-    RPCFuncHandle fhandle, TVMContext ctx, int number, int repeat) {
+    RPCFuncHandle fhandle, TVMContext ctx, int number, int repeat,
+    int max_repeat, double rel_ci, int64_t flush_cache_bytes,
+    const std::string& counters) {
   return this->CallRemote(
-      RPCCode::kGetTimeEvaluator, fhandle, ctx, number, repeat);
+      RPCCode::kGetTimeEvaluator, fhandle, ctx, number, repeat,
+      max_repeat, rel_ci, flush_cache_bytes, counters);
 }
 
 // Event handler functions
@@ -974,7 +1315,13 @@ void RPCModuleGetSource(TVMArgs args, TVMRetValue *rv) {
 
 void RPCGetTimeEvaluator(TVMArgs args, TVMRetValue *rv) {
   PackedFunc *pf = static_cast<PackedFunc*>(args[0].operator void*());
-  void *fhandle = new PackedFunc(WrapTimeEvaluator(*pf, args[1], args[2], args[3]));
+  // older clients only send the fixed repeat.
+  int max_repeat = args.size() > 4 ? args[4].operator int() : 0;
+  double rel_ci = args.size() > 5 ? args[5].operator double() : 0;
+  int64_t flush_cache_bytes = args.size() > 6 ? args[6].operator int64_t() : 0;
+  std::string counters = args.size() > 7 ? args[7].operator std::string() : "";
+  void *fhandle = new PackedFunc(WrapTimeEvaluator(
+      *pf, args[1], args[2], args[3], max_repeat, rel_ci, flush_cache_bytes, counters));
   delete pf;
   *rv = fhandle;
 }
@@ -1020,29 +1367,87 @@ void RPCSession::EventHandler::HandlePackedCall() {
     case RPCCode::kModuleFree: CallHandler(RPCModuleFree); break;
     case RPCCode::kModuleGetFunc: CallHandler(RPCModuleGetFunc); break;
     case RPCCode::kModuleGetSource: CallHandler(RPCModuleGetSource); break;
+    case RPCCode::kSetCompression: {
+      int codec = kRPCCodecNone;
+      uint64_t threshold = 0;
+      CallHandler([&codec, &threshold](TVMArgs args, TVMRetValue* rv) {
+          codec = args[0];
+          threshold = args[1];
+          if (codec != kRPCCodecBytePlaneRLE) codec = kRPCCodecNone;
+          *rv = codec;
+        });
+      // payloads after the reply use the accepted codec.
+      this->SetCompression(codec, threshold);
+      break;
+    }
     default: LOG(FATAL) << "Unknown event " << static_cast<int>(code_);
   }
   CHECK_EQ(state_, kRecvCode);
 }
 
-PackedFunc WrapTimeEvaluator(PackedFunc pf, TVMContext ctx, int number, int repeat) {
-  auto ftimer = [pf, ctx, number, repeat](TVMArgs args, TVMRetValue *rv) {
+// Whether the 95% confidence interval of the mean is within rel_ci of it.
+bool TimeConverged(const std::vector<double>& samples, double rel_ci) {
+  size_t n = samples.size();
+  if (n < 2) return false;
+  double mean = std::accumulate(samples.begin(), samples.end(), 0.0) / n;
+  double var = 0;
+  for (double t : samples) var += (t - mean) * (t - mean);
+  var /= n - 1;
+  // two-sided 97.5% quantiles of Student's t, approximated after 10 dof.
+  static const double kStudentT[] = {
+    12.71, 4.30, 3.18, 2.78, 2.57, 2.45, 2.36, 2.31, 2.26, 2.23};
+  size_t dof = n - 1;
+  double t = dof <= 10 ? kStudentT[dof - 1] : 1.96 + 2.4 / dof;
+  return t * std::sqrt(var / n) <= rel_ci * mean;
+}
+
+PackedFunc WrapTimeEvaluator(PackedFunc pf, TVMContext ctx, int number, int repeat,
+                             int max_repeat, double rel_ci, int64_t flush_cache_bytes,
+                             std::string counters) {
+  CHECK_GT(number, 0);
+  CHECK_GT(repeat, 0);
+  CHECK_GE(flush_cache_bytes, 0);
+  // kept across calls so that the flushing writes are not optimized away.
+  auto flush_buf = std::make_shared<std::vector<char> >(flush_cache_bytes);
+  auto ftimer = [pf, ctx, number, repeat, max_repeat, rel_ci, flush_buf, counters](
+      TVMArgs args, TVMRetValue *rv) {
     TVMRetValue temp;
     std::ostringstream os;
     // skip first time call, to activate lazy compilation components.
     pf.CallPacked(args, &temp);
     DeviceAPI::Get(ctx)->StreamSync(ctx, nullptr);
-    for (int i = 0; i < repeat; ++i) {
+    // opened after the first call has started the thread pool.
+    PerfCounters perf(counters);
+    if (perf.size() != 0) {
+      uint64_t header[2] = {kTimeEvalCountersMagic, perf.size()};
+      os.write(reinterpret_cast<char*>(header), sizeof(header));
+    }
+    std::vector<double> samples;
+    int limit = std::max(repeat, max_repeat);
+    for (int i = 0; i < limit; ++i) {
+      std::vector<char>& buf = *flush_buf;
+      for (size_t k = 0; k < buf.size(); k += 64) {
+        ++buf[k];
+      }
       // start timing
+      perf.Start();
       auto tbegin = std::chrono::high_resolution_clock::now();
       for (int i = 0; i < number; ++i) {
         pf.CallPacked(args, &temp);
       }
       DeviceAPI::Get(ctx)->StreamSync(ctx, nullptr);
       auto tend = std::chrono::high_resolution_clock::now();
+      std::vector<double> counts = perf.Stop();
       double speed = std::chrono::duration_cast<std::chrono::duration<double> >(
           tend - tbegin).count() / number;
       os.write(reinterpret_cast<char*>(&speed), sizeof(speed));
+      // followed by the counts per call.
+      for (double count : counts) {
+        count /= number;
+        os.write(reinterpret_cast<char*>(&count), sizeof(count));
+      }
+      samples.push_back(speed);
+      if (i + 1 >= repeat && rel_ci > 0 && TimeConverged(samples, rel_ci)) break;
     }
     std::string blob = os.str();
     TVMByteArray arr;
@@ -1054,5 +1459,10 @@ PackedFunc WrapTimeEvaluator(PackedFunc pf, TVMContext ctx, int number, int repe
   return PackedFunc(ftimer);
 }
 
+// Marks servers that understand kSetCompression.
+TVM_REGISTER_GLOBAL(kRPCCompressionMarker)
+.set_body([](TVMArgs args, TVMRetValue* rv) {
+    *rv = kRPCCodecBytePlaneRLE;
+  });
 }  // namespace runtime
 }  // namespace tvm
@@ -8,6 +8,8 @@
 
 #include <tvm/runtime/packed_func.h>
 #include <tvm/runtime/device_api.h>
+#include <map>
+#include <memory>
 #include <mutex>
 #include <string>
 #include "../../common/ring_buffer.h"
@@ -17,6 +19,21 @@ namespace runtime {
 
 const int kRPCMagic = 0xff271;
 
+/*! \brief Hand shake magic flag of a client that asks for a shared memory channel. */
+const int kRPCShmFlag = 0x100;
+
+/*! \brief Hand shake magic flag of a client that multiplexes sessions over the connection. */
+const int kRPCMuxFlag = 0x200;
+
+/*! \brief Global function registered by servers that accept kSetCompression. */
+constexpr const char* kRPCCompressionMarker = "tvm.contrib.rpc.server.compression";
+
+/*! \brief Default ring buffer bytes of each direction of a shared memory channel. */
+constexpr size_t kRPCShmDefaultCapacity = 4 << 20;
+
+/*! \brief Default maximum bytes of a copy message. */
+constexpr size_t kRPCDefaultChunkSize = 64 << 10;
+
 /*! \brief The remote functio handle */
 using RPCFuncHandle = void*;
 
@@ -48,6 +65,7 @@ enum class RPCCode : int {
   kModuleFree,
   kModuleGetFunc,
   kModuleGetSource,
+  kSetCompression,
 };
 
 /*!
@@ -72,6 +90,31 @@ e   * \brief Recv data from channel.
    * \return The actual bytes received.
    */
   virtual size_t Recv(void* data, size_t size) = 0;
+  /*!
+   * \brief Recv data into several buffers, filled in order.
+   *
+   *  Lets a bulk payload land in its destination while the bytes
+   *  after it are read ahead in the same call. The default
+   *  implementation only receives into the first non-empty buffer.
+   *
+   * \param bufs The data pointers.
+   * \param sizes The sizes of the buffers.
+   * \param num The number of buffers.
+   * \return The actual bytes received.
+   */
+  virtual size_t RecvV(void* const* bufs, const size_t* sizes, int num) {
+    for (int i = 0; i < num; ++i) {
+      if (sizes[i] != 0) return Recv(bufs[i], sizes[i]);
+    }
+    return 0;
+  }
+  /*!
+   * \brief Open another channel over the same connection.
+   * \return The new channel, nullptr when the connection is not multiplexed.
+   */
+  virtual std::unique_ptr<RPCChannel> OpenSibling() {
+    return nullptr;
+  }
 };
 
 // Bidirectional Communication Session of PackedRPC
@@ -140,6 +183,62 @@ class RPCSession {
                       size_t to_offset,
                       size_t size,
                       TVMContext ctx_from);
+  /*!
+   * \brief Send a function call without waiting for its return.
+   *
+   *  Requests of a session are served in order, so many of them can
+   *  be in flight. Each request gets a sequence id, the reply is
+   *  collected by Wait with that id.
+   *
+   * \param handle The function handle
+   * \param args The arguments, sent before the function returns.
+   * \param fwrap Wrapper function to turn Function/Module handle into real return.
+   * \return The sequence id of the request.
+   */
+  uint64_t AsyncCallFunc(RPCFuncHandle handle,
+                         TVMArgs args,
+                         const PackedFunc& fwrap);
+  /*!
+   * \brief Send bytes into remote array content without waiting.
+   *  The source is copied before the function returns.
+   * \return The sequence id of the request.
+   * \sa CopyToRemote
+   */
+  uint64_t AsyncCopyToRemote(void* from,
+                             size_t from_offset,
+                             void* to,
+                             size_t to_offset,
+                             size_t size,
+                             TVMContext ctx_to);
+  /*!
+   * \brief Request bytes from remote array content without waiting.
+   *  The target must stay alive until the request is done.
+   * \return The sequence id of the request.
+   * \sa CopyFromRemote
+   */
+  uint64_t AsyncCopyFromRemote(void* from,
+                               size_t from_offset,
+                               void* to,
+                               size_t to_offset,
+                               size_t size,
+                               TVMContext ctx_from);
+  /*!
+   * \brief Wait for the reply of an asynchronous request.
+   *  Rethrows the remote exception of the request.
+   * \param seq The sequence id of the request.
+   * \param rv The return value.
+   */
+  void Wait(uint64_t seq, TVMRetValue* rv);
+  /*!
+   * \brief Whether the reply of a request has been received.
+   * \param seq The sequence id of the request.
+   */
+  bool IsDone(uint64_t seq);
+  /*!
+   * \brief Drop the reply of a request nobody waits for.
+   * \param seq The sequence id of the request.
+   */
+  void Discard(uint64_t seq);
   /*!
    * \brief Get a remote timer function on ctx.
    *  This function consumes fhandle, caller should not call Free on fhandle.
@@ -148,12 +247,20 @@ class RPCSession {
    * \param ctx The ctx to run measurement on.
    * \param number How many steps to run in each time evaluation
    * \param repeat How many times to repeat the timer
+   * \param max_repeat The repeat limit when repeating until rel_ci is reached.
+   * \param rel_ci The target confidence interval relative to the mean.
+   * \param flush_cache_bytes The bytes written to evict the caches before each repeat.
+   * \param counters Comma separated hardware counters to collect.
    * \return A remote timer function
    */
   RPCFuncHandle GetTimeEvaluator(RPCFuncHandle fhandle,
                                  TVMContext ctx,
                                  int number,
-                                 int repeat);
+                                 int repeat,
+                                 int max_repeat = 0,
+                                 double rel_ci = 0,
+                                 int64_t flush_cache_bytes = 0,
+                                 const std::string& counters = "");
   /*!
    * \brief Call a remote defined system function with arguments.
    * \param fcode The function code.
@@ -162,6 +269,40 @@ class RPCSession {
    */
   template<typename... Args>
   inline TVMRetValue CallRemote(RPCCode fcode, Args&& ...args);
+  /*!
+   * \brief Set the maximum number of bytes of each copy message.
+   *
+   *  Larger copies are split in chunks. Each chunk is written into the
+   *  destination as it arrives, so the buffers on both sides stay at
+   *  the chunk size, and other requests can go between the chunks
+   *  of an asynchronous copy.
+   *
+   * \param chunk_size The chunk size in bytes, 0 sends a copy as one message.
+   */
+  void set_chunk_size(size_t chunk_size);
+  /*!
+   * \brief Negotiate the compression of bulk payloads with the server.
+   *
+   *  Array copies, strings and bytes of at least threshold bytes are
+   *  compressed in both directions once the server accepts the codec.
+   *  The codec is only proposed to servers that register
+   *  kRPCCompressionMarker, older servers get no request.
+   *
+   * \param codec The proposed codec, see RPCCodec.
+   * \param threshold The minimum size of a compressed payload.
+   * \return The codec accepted by the server, kRPCCodecNone if unsupported.
+   */
+  int SetCompression(int codec, size_t threshold);
+  /*!
+   * \brief Open another session over the connection of this one.
+   *
+   *  The sessions of a multiplexed connection have their own handles
+   *  and run concurrently on the server, which shares the uploaded
+   *  files among them.
+   *
+   * \return The new session.
+   */
+  std::shared_ptr<RPCSession> NewSession();
   /*!
    * \return The session table index of the session.
    */
@@ -190,6 +331,44 @@ class RPCSession {
   // Also flushes channels so that the function advances.
   RPCCode HandleUntilReturnEvent(
       TVMRetValue* rv, bool client_mode, const PackedFunc* fwrap);
+  // A request whose reply has not been consumed.
+  struct PendingRequest {
+    // The expected reply, kReturn or kCopyAck.
+    RPCCode reply{RPCCode::kReturn};
+    // Wrapper of returned function and module handles.
+    PackedFunc fwrap;
+    // Target of the copy from remote.
+    char* copy_to{nullptr};
+    size_t copy_size{0};
+    // Bytes of the reply payload counted in the window.
+    size_t nbytes{0};
+    // The next chunk of the same copy, 0 if none.
+    uint64_t chain_to{0};
+    bool done{false};
+    bool discarded{false};
+    TVMRetValue rv;
+    std::string error;
+  };
+  // Receive replies until the window has room for nbytes more.
+  void WaitWindow(size_t nbytes);
+  // Write the header of kCopyToRemote or kCopyFromRemote.
+  void WriteCopyHeader(RPCCode code,
+                       void* remote,
+                       size_t remote_offset,
+                       size_t data_size,
+                       TVMContext ctx);
+  // Let req finish the copy of the chunk prev, call right before
+  // writing req.
+  void ChainChunk(uint64_t prev, PendingRequest* req);
+  // Register the request just written and send it out.
+  uint64_t AddPending(PendingRequest req);
+  // Receive the reply of the oldest request in flight.
+  void RecvReply();
+  // Receive a payload of size bytes into data, starting with
+  // the bytes in the reader.
+  void RecvPayload(char* data, size_t size);
+  // Send the content of the writer to the channel.
+  void FlushWriter();
   // Initalization
   void Init();
   // Shutdown
@@ -208,16 +387,50 @@ class RPCSession {
   int table_index_{0};
   // The name of the session.
   std::string name_;
+  // Sequence id of the next request.
+  uint64_t next_seq_{0};
+  // Sequence id of the next reply to receive.
+  uint64_t recv_seq_{0};
+  // Bytes in flight, see WaitWindow.
+  size_t inflight_bytes_{0};
+  // Maximum bytes of each copy message, 0 for no limit.
+  size_t chunk_size_{kRPCDefaultChunkSize};
+  // Requests whose replies are not consumed.
+  std::map<uint64_t, PendingRequest> pending_;
 };
 
+/*!
+ * \brief Magic of the header of a timer result with counters. It reads
+ *  as a NaN double, so it never looks like the time of a repeat.
+ */
+constexpr uint64_t kTimeEvalCountersMagic = 0x7FF8C0DE0000C001ULL;
+
 /*!
  * \brief Wrap a timer function for a given packed function.
+ *
+ *  The timer returns the seconds per call of each repeat as doubles,
+ *  each followed by the count per call of every requested counter.
+ *  When counters are requested, the result starts with two uint64:
+ *  kTimeEvalCountersMagic and the number of counters.
+ *  When max_repeat is larger than repeat, it keeps repeating after
+ *  repeat runs until the 95% confidence interval of the mean is within
+ *  rel_ci of the mean, so the number of results varies.
+ *
  * \param f The function argument.
  * \param ctx The context.
  * \param number Number of steps in the inner iteration
  * \param repeat How many steps to repeat the time evaluation.
+ * \param max_repeat The repeat limit when repeating until rel_ci is reached.
+ * \param rel_ci The target half width of the confidence interval relative to the mean.
+ * \param flush_cache_bytes The bytes of memory written before each repeat
+ *  to evict the CPU caches, 0 to keep the caches warm.
+ * \param counters Comma separated hardware counters to collect with
+ *  perf_event_open, see PerfCounters.
  */
-PackedFunc WrapTimeEvaluator(PackedFunc f, TVMContext ctx, int number, int repeat);
+PackedFunc WrapTimeEvaluator(PackedFunc f, TVMContext ctx, int number, int repeat,
+                             int max_repeat = 0, double rel_ci = 0,
+                             int64_t flush_cache_bytes = 0,
+                             std::string counters = "");
 
 /*!
  * \brief Create a Global RPC module that refers to the session.
@@ -226,6 +439,42 @@ PackedFunc WrapTimeEvaluator(PackedFunc f, TVMContext ctx, int number, int repea
  */
 Module CreateRPCModule(std::shared_ptr<RPCSession> sess);
 
+/*!
+ * \brief Create a shared memory channel to a server on the same host.
+ *
+ *  The segment holds one ring buffer per direction, the waits sleep
+ *  on futexes. The name is passed to the server in the hand shake.
+ *
+ * \param peer_fd The socket of the hand shake, kept open to detect that
+ *  the server goes away, closed by the channel.
+ * \param capacity The ring buffer bytes of each direction.
+ * \param name The name of the shared memory segment.
+ * \return The created channel.
+ */
+std::unique_ptr<RPCChannel> CreateShmChannel(int peer_fd, size_t capacity, std::string* name);
+
+/*!
+ * \brief Attach the server side of a shared memory channel.
+ * \param peer_fd The socket of the hand shake, closed by the channel.
+ * \param name The name of the shared memory segment.
+ * \return The created channel.
+ */
+std::unique_ptr<RPCChannel> AttachShmChannel(int peer_fd, const std::string& name);
+
+/*!
+ * \brief Multiplex sessions over a channel, on the client side.
+ * \param channel The channel of the connection.
+ * \return The channel of the first session, OpenSibling opens the others.
+ */
+std::unique_ptr<RPCChannel> CreateMuxChannel(std::unique_ptr<RPCChannel> channel);
+
+/*!
+ * \brief Serve the multiplexed sessions of a connection, each in its
+ *  own thread, until the connection closes.
+ * \param channel The channel of the connection.
+ */
+void RPCMuxServerLoop(std::unique_ptr<RPCChannel> channel);
+
 // Remote space pointer.
 struct RemoteSpace {
   void* data;
@@ -0,0 +1,256 @@
+/*!
+ *  Copyright (c) 2018 by Contributors
+ * \file rpc_shm_impl.cc
+ * \brief Shared memory RPC channel for servers on the same host.
+ */
+#include <dmlc/logging.h>
+#include <memory>
+#include <string>
+#include "./rpc_session.h"
+
+// Bionic has no usable shm_open, Android servers only take socket channels.
+#if !defined(_WIN32) && !defined(__ANDROID__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <ctime>
+#include <random>
+#include <sstream>
+#include <thread>
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
+#endif
+
+namespace tvm {
+namespace runtime {
+
+#if !defined(_WIN32) && !defined(__ANDROID__)
+
+/*! \brief One direction of the channel, bytes are counted from the start. */
+struct ShmRing {
+  // owned by the sender.
+  alignas(64) std::atomic<uint64_t> head;
+  std::atomic<uint32_t> data_seq;
+  std::atomic<uint32_t> writer_waiting;
+  std::atomic<uint32_t> closed;
+  // owned by the receiver.
+  alignas(64) std::atomic<uint64_t> tail;
+  std::atomic<uint32_t> space_seq;
+  std::atomic<uint32_t> reader_waiting;
+};
+
+/*! \brief The start of the segment, followed by the data of the two rings. */
+struct ShmHeader {
+  uint64_t magic;
+  uint64_t capacity;
+  // client to server, then server to client.
+  ShmRing ring[2];
+};
+
+static_assert(sizeof(std::atomic<uint64_t>) == sizeof(uint64_t) &&
+              sizeof(std::atomic<uint32_t>) == sizeof(uint32_t),
+              "atomics in shared memory must be plain words");
+
+class ShmChannel final : public RPCChannel {
+ public:
+  ShmChannel(int peer_fd, void* base, size_t map_size,
+             std::string name, bool is_server)
+      : peer_fd_(peer_fd), base_(base), map_size_(map_size),
+        name_(name), is_server_(is_server) {
+    ShmHeader* header = static_cast<ShmHeader*>(base);
+    char* data = static_cast<char*>(base) + HeaderSize();
+    capacity_ = header->capacity;
+    int send = is_server ? 1 : 0;
+    send_ring_ = &header->ring[send];
+    recv_ring_ = &header->ring[1 - send];
+    send_data_ = data + send * capacity_;
+    recv_data_ = data + (1 - send) * capacity_;
+  }
+  ~ShmChannel() {
+    send_ring_->closed.store(1);
+    send_ring_->data_seq.fetch_add(1);
+    Wake(&send_ring_->data_seq);
+    munmap(base_, map_size_);
+    if (!is_server_) shm_unlink(name_.c_str());
+    close(peer_fd_);
+  }
+  size_t Send(const void* data, size_t size) final {
+    ShmRing* r = send_ring_;
+    uint64_t head = r->head.load(std::memory_order_relaxed);
+    size_t space = 0;
+    for (int spin = 0; ; ++spin) {
+      uint32_t seq = r->space_seq.load();
+      space = capacity_ - static_cast<size_t>(head - r->tail.load());
+      if (space != 0) break;
+      CHECK(!recv_ring_->closed.load()) << "ShmChannel::Send: peer closed";
+      if (spin < kSpinCount) continue;
+      r->writer_waiting.store(1);
+      bool woken = Wait(&r->space_seq, seq);
+      r->writer_waiting.store(0);
+      CHECK(woken || PeerAlive()) << "ShmChannel::Send: peer closed";
+    }
+    size_t n = std::min(size, space);
+    size_t pos = static_cast<size_t>(head % capacity_);
+    size_t first = std::min(n, capacity_ - pos);
+    std::memcpy(send_data_ + pos, data, first);
+    std::memcpy(send_data_, static_cast<const char*>(data) + first, n - first);
+    r->head.store(head + n);
+    r->data_seq.fetch_add(1);
+    if (r->reader_waiting.load()) Wake(&r->data_seq);
+    return n;
+  }
+  size_t Recv(void* data, size_t size) final {
+    ShmRing* r = recv_ring_;
+    uint64_t tail = r->tail.load(std::memory_order_relaxed);
+    size_t avail = 0;
+    for (int spin = 0; ; ++spin) {
+      uint32_t seq = r->data_seq.load();
+      avail = static_cast<size_t>(r->head.load() - tail);
+      if (avail != 0) break;
+      if (r->closed.load()) return 0;
+      if (spin < kSpinCount) continue;
+      r->reader_waiting.store(1);
+      bool woken = Wait(&r->data_seq, seq);
+      r->reader_waiting.store(0);
+      if (!woken && !PeerAlive()) return 0;
+    }
+    size_t n = std::min(size, avail);
+    size_t pos = static_cast<size_t>(tail % capacity_);
+    size_t first = std::min(n, capacity_ - pos);
+    std::memcpy(data, recv_data_ + pos, first);
+    std::memcpy(static_cast<char*>(data) + first, recv_data_, n - first);
+    r->tail.store(tail + n);
+    r->space_seq.fetch_add(1);
+    if (r->writer_waiting.load()) Wake(&r->space_seq);
+    return n;
+  }
+  /*! \return The bytes before the data of the rings. */
+  static size_t HeaderSize() {
+    return (sizeof(ShmHeader) + 63) / 64 * 64;
+  }
+
+  /*! \brief Magic number at the start of the segment. */
+  static constexpr uint64_t kMagic = 0x54564d53484d5250ULL;
+
+ private:
+  // Checks of an empty or full ring before sleeping, a round trip
+  // of small messages is mostly served without a system call.
+  // Spinning only delays the peer on a single core.
+  const int kSpinCount = std::thread::hardware_concurrency() > 1 ? 4000 : 0;
+  // Sleep until the word is bumped, return false on timeout.
+  static bool Wait(std::atomic<uint32_t>* word, uint32_t value) {
+#ifdef __linux__
+    timespec timeout{0, 100 * 1000 * 1000};
+    long ret = syscall(SYS_futex, reinterpret_cast<uint32_t*>(word), // NOLINT(*)
+                       FUTEX_WAIT, value, &timeout, nullptr, 0);
+    return ret == 0 || errno != ETIMEDOUT;
+#else
+    // no futex, poll the word.
+    timespec delay{0, 50 * 1000};
+    nanosleep(&delay, nullptr);
+    return word->load() != value;
+#endif
+  }
+  static void Wake(std::atomic<uint32_t>* word) {
+#ifdef __linux__
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(word),
+            FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+#endif
+  }
+  // The hand shake socket reads end of file once the peer exits.
+  bool PeerAlive() const {
+    char c;
+    ssize_t n = recv(peer_fd_, &c, 1, MSG_PEEK | MSG_DONTWAIT);
+    return n != 0 && (n > 0 || errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR);
+  }
+
+  int peer_fd_;
+  void* base_;
+  size_t map_size_;
+  std::string name_;
+  bool is_server_;
+  size_t capacity_;
+  ShmRing* send_ring_;
+  ShmRing* recv_ring_;
+  char* send_data_;
+  char* recv_data_;
+};
+
+constexpr uint64_t ShmChannel::kMagic;
+
+std::unique_ptr<RPCChannel> CreateShmChannel(int peer_fd, size_t capacity, std::string* name) {
+  CHECK_GT(capacity, 0U);
+  std::random_device rd;
+  std::ostringstream os;
+  os << "/tvm_rpc_" << getpid() << "_" << std::hex << rd() << rd();
+  *name = os.str();
+  int fd = shm_open(name->c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+  CHECK_NE(fd, -1) << "shm_open " << *name << " failed: " << strerror(errno);
+  size_t map_size = ShmChannel::HeaderSize() + 2 * capacity;
+  if (ftruncate(fd, static_cast<off_t>(map_size)) != 0) {
+    close(fd);
+    shm_unlink(name->c_str());
+    LOG(FATAL) << "cannot allocate " << map_size << " bytes of shared memory: "
+               << strerror(errno);
+  }
+  void* base = mmap(nullptr, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (base == MAP_FAILED) {
+    shm_unlink(name->c_str());
+    LOG(FATAL) << "mmap " << *name << " failed: " << strerror(errno);
+  }
+  // the new segment is zero filled, which is the empty state of the rings.
+  ShmHeader* header = static_cast<ShmHeader*>(base);
+  header->capacity = capacity;
+  header->magic = ShmChannel::kMagic;
+  return std::unique_ptr<RPCChannel>(
+      new ShmChannel(peer_fd, base, map_size, *name, false));
+}
+
+std::unique_ptr<RPCChannel> AttachShmChannel(int peer_fd, const std::string& name) {
+  int fd = shm_open(name.c_str(), O_RDWR, 0600);
+  CHECK_NE(fd, -1) << "shm_open " << name << " failed: " << strerror(errno);
+  // only the two ends keep the segment from now on.
+  shm_unlink(name.c_str());
+  struct stat st;
+  CHECK_EQ(fstat(fd, &st), 0) << "fstat " << name << " failed: " << strerror(errno);
+  size_t map_size = static_cast<size_t>(st.st_size);
+  CHECK_GE(map_size, ShmChannel::HeaderSize()) << name << " is not a TVM RPC channel";
+  void* base = mmap(nullptr, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  CHECK(base != MAP_FAILED) << "mmap " << name << " failed: " << strerror(errno);
+  ShmHeader* header = static_cast<ShmHeader*>(base);
+  if (header->magic != ShmChannel::kMagic ||
+      ShmChannel::HeaderSize() + 2 * header->capacity != map_size) {
+    munmap(base, map_size);
+    LOG(FATAL) << name << " is not a TVM RPC channel";
+  }
+  return std::unique_ptr<RPCChannel>(
+      new ShmChannel(peer_fd, base, map_size, name, true));
+}
+
+#else
+
+std::unique_ptr<RPCChannel> CreateShmChannel(int peer_fd, size_t capacity, std::string* name) {
+  LOG(FATAL) << "shared memory RPC channel is not supported on Windows and Android";
+  return nullptr;
+}
+
+std::unique_ptr<RPCChannel> AttachShmChannel(int peer_fd, const std::string& name) {
+  LOG(FATAL) << "shared memory RPC channel is not supported on Windows and Android";
+  return nullptr;
+}
+
+#endif  // !defined(_WIN32) && !defined(__ANDROID__)
+
+}  // namespace runtime
+}  // namespace tvm
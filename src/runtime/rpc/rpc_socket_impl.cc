@@ -14,7 +14,10 @@ namespace runtime {
 class SockChannel final : public RPCChannel {
  public:
   explicit SockChannel(common::TCPSocket sock)
-      : sock_(sock) {}
+      : sock_(sock) {
+    // pipelined requests are small writes that should not wait for acks.
+    sock_.SetNoDelay(true);
+  }
   ~SockChannel() {
     if (!sock_.BadSocket()) {
         sock_.Close();
@@ -34,45 +37,80 @@ class SockChannel final : public RPCChannel {
     }
     return static_cast<size_t>(n);
   }
+  size_t RecvV(void* const* bufs, const size_t* sizes, int num) final {
+    ssize_t n = sock_.RecvV(bufs, sizes, num);
+    if (n == -1) {
+      common::Socket::Error("SockChannel::RecvV");
+    }
+    return static_cast<size_t>(n);
+  }
 
  private:
   common::TCPSocket sock_;
 };
 
+// Send the hand shake, followed by the name of the shared memory
+// segment if any, return the reply of the server.
+int RPCHandshake(common::TCPSocket* sock, int magic,
+                 const std::string& key, const std::string& shm_name) {
+  int code = magic;
+  int keylen = static_cast<int>(key.length());
+  CHECK_EQ(sock->SendAll(&code, sizeof(code)), sizeof(code));
+  CHECK_EQ(sock->SendAll(&keylen, sizeof(keylen)), sizeof(keylen));
+  if (keylen != 0) {
+    CHECK_EQ(sock->SendAll(key.c_str(), keylen), keylen);
+  }
+  if ((magic - kRPCMagic) & kRPCShmFlag) {
+    int namelen = static_cast<int>(shm_name.length());
+    CHECK_EQ(sock->SendAll(&namelen, sizeof(namelen)), sizeof(namelen));
+    CHECK_EQ(sock->SendAll(shm_name.c_str(), namelen), namelen);
+  }
+  CHECK_EQ(sock->RecvAll(&code, sizeof(code)), sizeof(code));
+  return code;
+}
+
 std::shared_ptr<RPCSession>
-RPCConnect(std::string url, int port, std::string key) {
+RPCConnect(std::string url, int port, std::string key,
+           std::string transport, bool multiplex = false) {
   common::TCPSocket sock;
   common::SockAddr addr(url.c_str(), port);
   sock.Create();
   CHECK(sock.Connect(addr))
       << "Connect to " << addr.AsString() << " failed";
-  // hand shake
-  std::ostringstream os;
-  int code = kRPCMagic;
-  int keylen = static_cast<int>(key.length());
-  CHECK_EQ(sock.SendAll(&code, sizeof(code)), sizeof(code));
-  CHECK_EQ(sock.SendAll(&keylen, sizeof(keylen)), sizeof(keylen));
-  if (keylen != 0) {
-    CHECK_EQ(sock.SendAll(key.c_str(), keylen), keylen);
+  // hand shake, the channel owns the socket from here.
+  std::unique_ptr<RPCChannel> channel;
+  int magic = kRPCMagic + (multiplex ? kRPCMuxFlag : 0);
+  int code;
+  if (transport == "shm") {
+    std::string shm_name;
+    channel = CreateShmChannel(static_cast<int>(sock.sockfd),
+                               kRPCShmDefaultCapacity, &shm_name);
+    code = RPCHandshake(&sock, magic + kRPCShmFlag, key, shm_name);
+  } else {
+    CHECK_EQ(transport, "tcp") << "unknown RPC transport " << transport;
+    channel.reset(new SockChannel(sock));
+    code = RPCHandshake(&sock, magic, key, "");
   }
-  CHECK_EQ(sock.RecvAll(&code, sizeof(code)), sizeof(code));
+  if (code != kRPCMagic) channel.reset();
   if (code == kRPCMagic + 2) {
-    sock.Close();
     LOG(FATAL) << "URL " << url << ":" << port
                << " cannot find server that matches key=" << key;
   } else if (code == kRPCMagic + 1) {
-    sock.Close();
     LOG(FATAL) << "URL " << url << ":" << port
                << " server already have key=" << key;
+  } else if (code == kRPCMagic + 3) {
+    LOG(FATAL) << "URL " << url << ":" << port
+               << " does not accept shared memory channels";
   } else if (code != kRPCMagic) {
-    sock.Close();
     LOG(FATAL) << "URL " << url << ":" << port << " is not TVM RPC server";
   }
-  return RPCSession::Create(std::unique_ptr<SockChannel>(new SockChannel(sock)), key);
+  if (multiplex) channel = CreateMuxChannel(std::move(channel));
+  return RPCSession::Create(std::move(channel), key);
 }
 
-Module RPCClientConnect(std::string url, int port, std::string key) {
-  return CreateRPCModule(RPCConnect(url, port, "client:" + key));
+Module RPCClientConnect(std::string url, int port, std::string key,
+                        std::string transport, bool multiplex) {
+  return CreateRPCModule(RPCConnect(url, port, "client:" + key, transport, multiplex));
 }
 
 void RPCServerLoop(int sockfd) {
@@ -83,14 +121,40 @@ void RPCServerLoop(int sockfd) {
                      "SockServerLoop")->ServerLoop();
 }
 
+void RPCServerLoopShm(int sockfd, std::string shm_name) {
+  RPCSession::Create(AttachShmChannel(sockfd, shm_name), "ShmServerLoop")->ServerLoop();
+}
+
+void RPCServerLoopMux(int sockfd, std::string shm_name) {
+  if (!shm_name.empty()) {
+    RPCMuxServerLoop(AttachShmChannel(sockfd, shm_name));
+    return;
+  }
+  common::TCPSocket sock(
+      static_cast<common::TCPSocket::SockType>(sockfd));
+  RPCMuxServerLoop(std::unique_ptr<SockChannel>(new SockChannel(sock)));
+}
+
 TVM_REGISTER_GLOBAL("contrib.rpc._Connect")
 .set_body([](TVMArgs args, TVMRetValue* rv) {
-    *rv = RPCClientConnect(args[0], args[1], args[2]);
+    std::string transport = args.size() > 3 ? args[3].operator std::string() : "tcp";
+    bool multiplex = args.size() > 4 ? args[4].operator bool() : false;
+    *rv = RPCClientConnect(args[0], args[1], args[2], transport, multiplex);
   });
 
 TVM_REGISTER_GLOBAL("contrib.rpc._ServerLoop")
 .set_body([](TVMArgs args, TVMRetValue* rv) {
     RPCServerLoop(args[0]);
   });
+
+TVM_REGISTER_GLOBAL("contrib.rpc._ServerLoopShm")
+.set_body([](TVMArgs args, TVMRetValue* rv) {
+    RPCServerLoopShm(args[0], args[1]);
+  });
+
+TVM_REGISTER_GLOBAL("contrib.rpc._ServerLoopMux")
+.set_body([](TVMArgs args, TVMRetValue* rv) {
+    RPCServerLoopMux(args[0], args[1]);
+  });
 }  // namespace runtime
 }  // namespace tvm
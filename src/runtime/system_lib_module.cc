@@ -30,6 +30,14 @@ class SystemLibModuleNode : public ModuleNode {
       module_blob_ = nullptr;
     }
 
+    if (name == runtime::symbol::tvm_get_backend_func_addr) {
+      return PackedFunc([sptr_to_self, this](TVMArgs args, TVMRetValue* rv) {
+          std::lock_guard<std::mutex> lock(mutex_);
+          auto it = tbl_.find(args[0].operator std::string());
+          void* addr = it != tbl_.end() ? it->second : nullptr;
+          *rv = addr;
+        });
+    }
     auto it = tbl_.find(name);
     if (it != tbl_.end()) {
       return WrapPackedFunc(
@@ -56,6 +56,32 @@ class WorkspacePool {
   std::shared_ptr<DeviceAPI> device_;
 };
 
+/*! \brief A backend workspace allocation or free, recorded by a trace. */
+struct WorkspaceEvent {
+  /*! \brief The context of the event */
+  TVMContext ctx;
+  /*! \brief The number of bytes allocated */
+  uint64_t nbytes;
+  /*! \brief The type hint of the allocation */
+  TVMType type_hint;
+  /*! \brief -1 for an allocation, the index of the freed allocation otherwise */
+  int64_t free_of;
+};
+
+/*!
+ * \brief Start recording the backend workspace events of the calling thread.
+ *  The previous record of the thread is discarded.
+ * \note Only the calling thread is traced. Kernels that allocate inside a
+ *  TVMBackendParallelLaunch task do so on the pool threads, from their own
+ *  thread local workspace pools, and are not recorded.
+ */
+void StartWorkspaceTrace();
+/*!
+ * \brief Stop recording the backend workspace events of the calling thread.
+ * \return The events since StartWorkspaceTrace, in order.
+ */
+std::vector<WorkspaceEvent> StopWorkspaceTrace();
+
 }  // namespace runtime
 }  // namespace tvm
 #endif  // TVM_RUNTIME_WORKSPACE_POOL_H_
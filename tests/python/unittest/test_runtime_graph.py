@@ -1,7 +1,39 @@
 import tvm
 import numpy as np
 import json
-from tvm.contrib import rpc, util, graph_runtime
+import threading
+from tvm.contrib import rpc, util, graph_runtime, graph_batcher
+
+def _op(name, func, inputs):
+    """A tvm_op node with one output that calls func."""
+    return {"op": "tvm_op", "name": name, "inputs": inputs,
+            "attrs": {"func_name": func,
+                      "flatten_data": "0",
+                      "num_inputs" : str(len(inputs)),
+                      "num_outputs" : "1"}}
+
+def _graph_json(nodes, heads, shapes, dtypes=None, **attrs):
+    """The json of a graph with one entry and one storage per node.
+    The null nodes are the arguments, attrs adds list_int attributes."""
+    num = len(nodes)
+    graph_attrs = {
+        "shape" : ["list_shape", shapes],
+        "dltype" : ["list_str", dtypes or ["float32"] * num],
+        "storage_id" : ["list_int", list(range(num))],
+    }
+    for key, value in attrs.items():
+        graph_attrs[key] = ["list_int", value]
+    return json.dumps({"nodes": nodes,
+                       "arg_nodes": [i for i, node in enumerate(nodes) if node["op"] == "null"],
+                       "node_row_ptr": list(range(num + 1)),
+                       "heads": heads,
+                       "attrs": graph_attrs})
+
+def _llvm_enabled():
+    if not tvm.module.enabled("llvm"):
+        print("Skip because llvm is not enabled")
+        return False
+    return True
 
 def test_graph_simple():
     n = 4
@@ -64,8 +96,565 @@ def test_graph_simple():
         out = mod.get_output(0, out)
         np.testing.assert_equal(out.asnumpy(), a + 1)
 
+    def check_deploy():
+        if not tvm.module.enabled("llvm"):
+            print("Skip because llvm is not enabled")
+            return
+        mlib = tvm.build(s, [A, B], "llvm", name="myadd")
+        mod = graph_runtime.create(graph, mlib, tvm.cpu(0))
+        temp = util.tempdir()
+        path_dso = temp.relpath("deploy.so")
+        graph_runtime.export_deploy(mod, mlib, path_dso)
+        mod = graph_runtime.load_deploy(path_dso, tvm.cpu(0))
+        a = np.random.uniform(size=(n,)).astype(A.dtype)
+        mod.run(x=a)
+        out = mod.get_output(0, tvm.nd.empty((n,)))
+        np.testing.assert_equal(out.asnumpy(), a + 1)
+
+    def check_profile():
+        if not tvm.module.enabled("llvm"):
+            print("Skip because llvm is not enabled")
+            return
+        mlib = tvm.build(s, [A, B], "llvm", name="myadd")
+        mod = graph_runtime.create(graph, mlib, tvm.cpu(0))
+        mod.set_input(x=np.random.uniform(size=(n,)).astype(A.dtype))
+        records = mod.profile(number=3, warmup=1)
+        assert len(records) == 1
+        assert records[0]["name"] == "add"
+        assert records[0]["func_name"] == "myadd"
+        assert records[0]["bytes_read"] == n * 4
+        assert records[0]["bytes_written"] == n * 4
+        assert records[0]["time_us"] >= 0
+
+    def check_binary():
+        if not tvm.module.enabled("llvm"):
+            print("Skip because llvm is not enabled")
+            return
+        mlib = tvm.build(s, [A, B], "llvm", name="myadd")
+        binary = graph_runtime.convert_to_binary(graph)
+        assert isinstance(binary, bytearray)
+        mod = graph_runtime.create(binary, mlib, tvm.cpu(0))
+        a = np.random.uniform(size=(n,)).astype(A.dtype)
+        mod.run(x=a)
+        out = mod.get_output(0, tvm.nd.empty((n,)))
+        np.testing.assert_equal(out.asnumpy(), a + 1)
+
+    def check_plan_memory():
+        if not tvm.module.enabled("llvm"):
+            print("Skip because llvm is not enabled")
+            return
+        mlib = tvm.build(s, [A, B], "llvm", name="myadd")
+        mod = graph_runtime.create(graph, mlib, tvm.cpu(0))
+        a = np.random.uniform(size=(n,)).astype(A.dtype)
+        mod.set_input(x=a)
+        nbytes = mod.plan_memory(alignment=64)
+        assert nbytes == mod.memory_footprint()
+        mod.run()
+        out = mod.get_output(0, tvm.nd.empty((n,)))
+        np.testing.assert_equal(out.asnumpy(), a + 1)
+
+    def check_warmup():
+        if not tvm.module.enabled("llvm"):
+            print("Skip because llvm is not enabled")
+            return
+        mlib = tvm.build(s, [A, B], "llvm", name="myadd")
+        mod = graph_runtime.create(graph, mlib, tvm.cpu(0))
+        a = np.random.uniform(size=(n,)).astype(A.dtype)
+        mod.set_input(x=a)
+        report = mod.warmup(number=2, fill_value=3.0)
+        assert report["storage_bytes"] == 2 * n * 4
+        assert report["first_run_us"] >= 0
+        out = mod.get_output(0, tvm.nd.empty((n,)))
+        np.testing.assert_equal(out.asnumpy(), np.full((n,), 4.0, dtype=A.dtype))
+        # the input set before warmup is kept
+        mod.run()
+        out = mod.get_output(0, tvm.nd.empty((n,)))
+        np.testing.assert_equal(out.asnumpy(), a + 1)
+        state = mod.save_warm_state()
+        mod2 = graph_runtime.create(graph, mlib, tvm.cpu(0))
+        mod2.load_warm_state(state)
+        assert mod2.save_warm_state() == state
+
+    def check_run_plan():
+        if not tvm.module.enabled("llvm"):
+            print("Skip because llvm is not enabled")
+            return
+        mlib = tvm.build(s, [A, B], "llvm", name="myadd")
+        mod = graph_runtime.create(graph, mlib, tvm.cpu(0))
+        a = np.random.uniform(size=(n,)).astype(A.dtype)
+        mod.set_input(x=a)
+        report = mod.compile_run_plan()
+        assert report["validated"] == 1
+        assert report["num_direct"] == 1
+        b = np.random.uniform(size=(n,)).astype(A.dtype)
+        mod.run(x=b)
+        out = mod.get_output(0, tvm.nd.empty((n,)))
+        np.testing.assert_equal(out.asnumpy(), b + 1)
+
+    def check_output_callback():
+        if not tvm.module.enabled("llvm"):
+            print("Skip because llvm is not enabled")
+            return
+        mlib = tvm.build(s, [A, B], "llvm", name="myadd")
+        mod = graph_runtime.create(graph, mlib, tvm.cpu(0))
+        a = np.random.uniform(size=(n,)).astype(A.dtype)
+        results = []
+        def callback(index, out):
+            results.append((index, out.asnumpy()))
+        mod.set_output_callback(0, callback)
+        mod.run(x=a)
+        assert len(results) == 1
+        assert results[0][0] == 0
+        np.testing.assert_equal(results[0][1], a + 1)
+        mod.set_output_callback(0, None)
+        mod.run(x=a)
+        assert len(results) == 1
+
     check_verify()
+    check_profile()
+    check_output_callback()
+    check_run_plan()
+    check_warmup()
+    check_binary()
+    check_plan_memory()
+    check_deploy()
     check_remote()
 
+def test_graph_dynamic_batch():
+    n = 4
+    m = tvm.var("m")
+    A = tvm.placeholder((m, n), name='A')
+    B = tvm.compute(A.shape, lambda *i: A(*i) + 1.0, name='B')
+    s = tvm.create_schedule(B.op)
+
+    node0 = {"op": "null", "name": "x", "inputs": []}
+    node1 = {"op": "tvm_op", "name": "add",
+             "inputs": [[0, 0, 0]],
+             "attrs": {"func_name": "myadd",
+                       "flatten_data": "0",
+                       "num_inputs" : "1",
+                       "num_outputs" : "1"}}
+    shape = (-1, n)
+    attrs = {
+        "shape" : ["list_shape", [shape, shape]],
+        "dltype" : ["list_str", ["float32", "float32"]],
+        "storage_id" : ["list_int", [0, 1]],
+        "max_batch_size" : ["size_t", 8],
+    }
+    graph = {"nodes": [node0, node1],
+             "arg_nodes": [0],
+             "node_row_ptr": [0, 1, 2],
+             "heads": [[1, 0, 0]],
+             "attrs": attrs}
+    graph = json.dumps(graph)
+
+    if not tvm.module.enabled("llvm"):
+        print("Skip because llvm is not enabled")
+        return
+    mlib = tvm.build(s, [A, B], "llvm", name="myadd")
+    mod = graph_runtime.create(graph, mlib, tvm.cpu(0))
+    for batch in [8, 3, 1]:
+        a = np.random.uniform(size=(batch, n)).astype(A.dtype)
+        mod.set_batch_size(batch)
+        mod.run(x=a)
+        out = mod.get_output(0, tvm.nd.empty((batch, n)))
+        np.testing.assert_equal(out.asnumpy(), a + 1)
+
+def test_graph_fuse_shape_ops():
+    n = 8
+    A = tvm.placeholder((n,), name='A')
+    B = tvm.compute(A.shape, lambda *i: A(*i) + 1.0, name='B')
+    X = tvm.placeholder((n,), name='X')
+    Y = tvm.compute((2, n // 2), lambda i, j: X[i * (n // 2) + j], name='Y')
+    fadd = tvm.lower(tvm.create_schedule(B.op), [A, B], name="myadd")
+    freshape = tvm.lower(tvm.create_schedule(Y.op), [X, Y], name="fuse_reshape")
+
+    node0 = {"op": "null", "name": "x", "inputs": []}
+    node1 = {"op": "tvm_op", "name": "add",
+             "inputs": [[0, 0, 0]],
+             "attrs": {"func_name": "myadd",
+                       "flatten_data": "0",
+                       "num_inputs" : "1",
+                       "num_outputs" : "1"}}
+    node2 = {"op": "tvm_op", "name": "reshape",
+             "inputs": [[1, 0, 0]],
+             "attrs": {"func_name": "fuse_reshape",
+                       "flatten_data": "0",
+                       "num_inputs" : "1",
+                       "num_outputs" : "1"}}
+    attrs = {
+        "shape" : ["list_shape", [(n,), (n,), (2, n // 2)]],
+        "dltype" : ["list_str", ["float32", "float32", "float32"]],
+        "storage_id" : ["list_int", [0, 1, 2]],
+    }
+    graph = {"nodes": [node0, node1, node2],
+             "arg_nodes": [0],
+             "node_row_ptr": [0, 1, 2, 3],
+             "heads": [[2, 0, 0]],
+             "attrs": attrs}
+    graph = json.dumps(graph)
+
+    if not tvm.module.enabled("llvm"):
+        print("Skip because llvm is not enabled")
+        return
+    mlib = tvm.build([fadd, freshape], "llvm")
+    mod = graph_runtime.create(graph, mlib, tvm.cpu(0))
+    a = np.random.uniform(size=(n,)).astype(A.dtype)
+    # by default the storage plan of the graph is kept.
+    mod.run(x=a)
+    out = mod.get_output(0, tvm.nd.empty((2, n // 2)))
+    np.testing.assert_equal(out.asnumpy(), (a + 1).reshape(2, n // 2))
+    assert mod.memory_footprint() == 3 * n * 4
+    assert [r["name"] for r in mod.profile(number=1)] == ["add", "reshape"]
+    assert mod.fuse_shape_ops() == 1
+    mod.run(x=a)
+    out = mod.get_output(0, tvm.nd.empty((2, n // 2)))
+    np.testing.assert_equal(out.asnumpy(), (a + 1).reshape(2, n // 2))
+    # reshape output aliases the add output, only input and output remain.
+    assert mod.memory_footprint() == 2 * 64
+    assert [r["name"] for r in mod.profile(number=1)] == ["add"]
+
+def test_graph_heterogeneous():
+    n = 4
+    A = tvm.placeholder((n,), name='A')
+    B = tvm.compute(A.shape, lambda *i: A(*i) + 1.0, name='B')
+    s = tvm.create_schedule(B.op)
+
+    node0 = {"op": "null", "name": "x", "inputs": []}
+    node1 = {"op": "tvm_op", "name": "add0",
+             "inputs": [[0, 0, 0]],
+             "attrs": {"func_name": "myadd",
+                       "flatten_data": "1",
+                       "num_inputs" : "1",
+                       "num_outputs" : "1"}}
+    node2 = {"op": "tvm_op", "name": "add1",
+             "inputs": [[1, 0, 0]],
+             "attrs": {"func_name": "myadd",
+                       "flatten_data": "1",
+                       "num_inputs" : "1",
+                       "num_outputs" : "1"}}
+    attrs = {
+        "shape" : ["list_shape", [(n,), (n,), (n,)]],
+        "dltype" : ["list_str", ["float32", "float32", "float32"]],
+        "storage_id" : ["list_int", [0, 1, 2]],
+        "device_index" : ["list_int", [0, 0, 1]],
+    }
+    graph = {"nodes": [node0, node1, node2],
+             "arg_nodes": [0],
+             "node_row_ptr": [0, 1, 2, 3],
+             "heads": [[2, 0, 0]],
+             "attrs": attrs}
+    graph = json.dumps(graph)
+
+    if not tvm.module.enabled("llvm"):
+        print("Skip because llvm is not enabled")
+        return
+    mlib = tvm.build(s, [A, B], "llvm", name="myadd")
+    mod = graph_runtime.create(graph, mlib, [tvm.cpu(0), tvm.cpu(1)])
+    a = np.random.uniform(size=(n,)).astype(A.dtype)
+    mod.run(x=a)
+    out = mod.get_output(0, tvm.nd.empty((n,)))
+    np.testing.assert_equal(out.asnumpy(), a + 2)
+    # a device index out of range is rejected.
+    try:
+        graph_runtime.create(graph, mlib, tvm.cpu(0))
+        assert False
+    except tvm.TVMError:
+        pass
+
+def test_graph_quantized_params():
+    n = 4
+    A = tvm.placeholder((n, n), name='A')
+    W = tvm.placeholder((n, n), name='W')
+    B = tvm.compute(A.shape, lambda i, j: A[i, j] + W[i, j], name='B')
+    s = tvm.create_schedule(B.op)
+
+    node0 = {"op": "null", "name": "x", "inputs": []}
+    node1 = {"op": "null", "name": "w", "inputs": []}
+    node2 = {"op": "tvm_op", "name": "add",
+             "inputs": [[0, 0, 0], [1, 0, 0]],
+             "attrs": {"func_name": "myadd",
+                       "flatten_data": "0",
+                       "num_inputs" : "2",
+                       "num_outputs" : "1"}}
+    shape = (n, n)
+    attrs = {
+        "shape" : ["list_shape", [shape, shape, shape]],
+        "dltype" : ["list_str", ["float32", "float32", "float32"]],
+        "storage_id" : ["list_int", [0, 1, 2]],
+    }
+    graph = {"nodes": [node0, node1, node2],
+             "arg_nodes": [0, 1],
+             "node_row_ptr": [0, 1, 2, 3],
+             "heads": [[2, 0, 0]],
+             "attrs": attrs}
+    graph = json.dumps(graph)
+
+    if not tvm.module.enabled("llvm"):
+        print("Skip because llvm is not enabled")
+        return
+    mlib = tvm.build(s, [A, W, B], "llvm", name="myadd")
+    a = np.random.uniform(size=shape).astype(A.dtype)
+    w = np.random.uniform(-1, 1, size=shape).astype(W.dtype)
+    for dtype, atol in [("int8", 1.0 / 127), ("float16", 1e-3)]:
+        mod = graph_runtime.create(graph, mlib, tvm.cpu(0))
+        mod.load_params(graph_runtime.save_quantized_params({"w": w}, dtype=dtype))
+        mod.run(x=a)
+        out = mod.get_output(0, tvm.nd.empty(shape))
+        np.testing.assert_allclose(out.asnumpy(), a + w, atol=atol)
+
+    # an int8 input takes the raw data and its scales go to w_scale
+    def int8_graph(with_scale):
+        names = ["w", "w_scale"] if with_scale else ["w"]
+        nodes = [{"op": "null", "name": name, "inputs": []} for name in names]
+        attrs = {
+            "shape" : ["list_shape", [shape, (n,)][:len(names)]],
+            "dltype" : ["list_str", ["int8", "float32"][:len(names)]],
+            "storage_id" : ["list_int", list(range(len(names)))],
+        }
+        return json.dumps({"nodes": nodes,
+                           "arg_nodes": list(range(len(names))),
+                           "node_row_ptr": list(range(len(names) + 1)),
+                           "heads": [[i, 0, 0] for i in range(len(names))],
+                           "attrs": attrs})
+    params = graph_runtime.save_quantized_params({"w": w}, dtype="int8", axis=0)
+    scales = np.abs(w).max(axis=1) / 127.0
+    mod = graph_runtime.create(int8_graph(True), mlib, tvm.cpu(0))
+    mod.load_params(params)
+    q = mod.get_output(0, tvm.nd.empty(shape, dtype="int8")).asnumpy()
+    s = mod.get_output(1, tvm.nd.empty((n,))).asnumpy()
+    np.testing.assert_allclose(s, scales, rtol=1e-6)
+    np.testing.assert_allclose(q * s[:, None], w, atol=1.0 / 127)
+    mod = graph_runtime.create(int8_graph(False), mlib, tvm.cpu(0))
+    try:
+        mod.load_params(params)
+        assert False, "scaled int8 param without w_scale must be rejected"
+    except tvm.TVMError:
+        pass
+
+def test_graph_batcher():
+    n = 4
+    m = tvm.var("m")
+    A = tvm.placeholder((m, n), name='A')
+    B = tvm.compute(A.shape, lambda *i: A(*i) + 1.0, name='B')
+    s = tvm.create_schedule(B.op)
+
+    node0 = {"op": "null", "name": "x", "inputs": []}
+    node1 = {"op": "tvm_op", "name": "add",
+             "inputs": [[0, 0, 0]],
+             "attrs": {"func_name": "myadd",
+                       "flatten_data": "0",
+                       "num_inputs" : "1",
+                       "num_outputs" : "1"}}
+    shape = (-1, n)
+    attrs = {
+        "shape" : ["list_shape", [shape, shape]],
+        "dltype" : ["list_str", ["float32", "float32"]],
+        "storage_id" : ["list_int", [0, 1]],
+        "max_batch_size" : ["size_t", 4],
+    }
+    graph = {"nodes": [node0, node1],
+             "arg_nodes": [0],
+             "node_row_ptr": [0, 1, 2],
+             "heads": [[1, 0, 0]],
+             "attrs": attrs}
+    graph = json.dumps(graph)
+
+    if not tvm.module.enabled("llvm"):
+        print("Skip because llvm is not enabled")
+        return
+    mlib = tvm.build(s, [A, B], "llvm", name="myadd")
+    for dynamic_batch in [True, False]:
+        mod = graph_runtime.create(graph, mlib, tvm.cpu(0))
+        mod.set_batch_size(4)
+        batcher = graph_batcher.GraphBatcher(
+            mod, ["x"], [(n,)], max_batch_size=4, timeout_ms=50,
+            dynamic_batch=dynamic_batch, latency_window=4)
+        samples = [np.random.uniform(size=(n,)).astype(A.dtype) for _ in range(10)]
+        futures = [None] * len(samples)
+        def submit(i):
+            futures[i] = batcher.submit(x=samples[i])
+        threads = [threading.Thread(target=submit, args=(i,)) for i in range(len(samples))]
+        for t in threads:
+            t.start()
+        for t in threads:
+            t.join()
+        for sample, future in zip(samples, futures):
+            np.testing.assert_equal(future.result(timeout=10)[0], sample + 1)
+        batcher.close()
+        stats = batcher.stats()
+        assert stats["num_requests"] == len(samples)
+        assert stats["num_batches"] < len(samples)
+        assert stats["latency_p99_ms"] >= stats["latency_p50_ms"]
+        assert stats["latency_samples"] == 4
+
+def test_graph_optimize_order():
+    n = 16
+    A = tvm.placeholder((n,), name='A')
+    B = tvm.compute(A.shape, lambda *i: A(*i) + 1.0, name='B')
+    X = tvm.placeholder((n,), name='X')
+    Y = tvm.placeholder((n,), name='Y')
+    Z = tvm.compute(X.shape, lambda *i: X(*i) + Y(*i), name='Z')
+    fadd = tvm.lower(tvm.create_schedule(B.op), [A, B], name="myadd")
+    fsum = tvm.lower(tvm.create_schedule(Z.op), [X, Y, Z], name="mysum")
+
+    # two branches, the json order runs both producers first.
+    nodes = [{"op": "null", "name": "x", "inputs": []},
+             _op("p1", "myadd", [[0, 0, 0]]),
+             _op("p2", "myadd", [[0, 0, 0]]),
+             _op("c1", "myadd", [[1, 0, 0]]),
+             _op("c2", "myadd", [[2, 0, 0]]),
+             _op("s", "mysum", [[3, 0, 0], [4, 0, 0]])]
+    graph = _graph_json(nodes, [[5, 0, 0]], [(n,)] * 6)
+
+    if not _llvm_enabled():
+        return
+    mlib = tvm.build([fadd, fsum], "llvm")
+    mod = graph_runtime.create(graph, mlib, tvm.cpu(0))
+    a = np.random.uniform(size=(n,)).astype(A.dtype)
+    mod.set_input(x=a)
+    # the compiler's storage plan stays until optimize_order is called.
+    assert mod.memory_footprint() == 6 * n * 4
+    report = mod.optimize_order()
+    assert report["reordered"]
+    assert report["peak_bytes_after"] <= report["peak_bytes_before"]
+    assert report["reuse_distance_after"] < report["reuse_distance_before"]
+    assert report["arena_bytes"] == mod.memory_footprint()
+    # the order is already optimal, the storage is left as is.
+    footprint = mod.memory_footprint()
+    report = mod.optimize_order()
+    assert not report["reordered"]
+    assert report["arena_bytes"] == footprint == mod.memory_footprint()
+    mod.run()
+    out = mod.get_output(0, tvm.nd.empty((n,)))
+    np.testing.assert_allclose(out.asnumpy(), 2 * a + 4, rtol=1e-5)
+
+def test_graph_gate():
+    n = 4
+    A = tvm.placeholder((n,), name='A')
+    B = tvm.compute(A.shape, lambda *i: A(*i) + 1.0, name='B')
+    C = tvm.compute((1,), lambda i: (A[0] > 0.5).astype("int32"), name='C')
+    fadd = tvm.lower(tvm.create_schedule(B.op), [A, B], name="myadd")
+    fcond = tvm.lower(tvm.create_schedule(C.op), [A, C], name="mycond")
+
+    # cond decides whether the head runs.
+    nodes = [{"op": "null", "name": "x", "inputs": []},
+             _op("cond", "mycond", [[0, 0, 0]]),
+             _op("head", "myadd", [[0, 0, 0]])]
+    graph = _graph_json(nodes, [[1, 0, 0], [2, 0, 0]], [(n,), (1,), (n,)],
+                        ["float32", "int32", "float32"], gate=[-1, -1, 1])
+
+    if not _llvm_enabled():
+        return
+    mlib = tvm.build([fadd, fcond], "llvm")
+    mod = graph_runtime.create(graph, mlib, tvm.cpu(0))
+    a = np.full((n,), 0.9, dtype=A.dtype)
+    mod.run(x=a)
+    assert mod.output_valid(1)
+    out = mod.get_output(1, tvm.nd.empty((n,)))
+    np.testing.assert_allclose(out.asnumpy(), a + 1)
+    mod.run(x=np.full((n,), 0.1, dtype=A.dtype))
+    assert mod.output_valid(0)
+    assert not mod.output_valid(1)
+    # the skipped head keeps the output of the previous run.
+    out = mod.get_output(1, tvm.nd.empty((n,)))
+    np.testing.assert_allclose(out.asnumpy(), a + 1)
+    # profiling skips the closed head as well.
+    records = {r["name"]: r for r in mod.profile(number=3, warmup=0)}
+    assert records["cond"]["num_runs"] == 3
+    assert records["head"]["num_runs"] == 0
+
+def test_graph_gate_heterogeneous():
+    n = 4
+    A = tvm.placeholder((n,), name='A')
+    B = tvm.compute(A.shape, lambda *i: A(*i) + 1.0, name='B')
+    C = tvm.compute((1,), lambda i: (A[0] > 0.5).astype("int32"), name='C')
+    fadd = tvm.lower(tvm.create_schedule(B.op), [A, B], name="myadd")
+    fcond = tvm.lower(tvm.create_schedule(C.op), [A, C], name="mycond")
+
+    # x is copied to device 1 for the gated head and the ungated tail.
+    nodes = [{"op": "null", "name": "x", "inputs": []},
+             _op("cond", "mycond", [[0, 0, 0]]),
+             _op("head", "myadd", [[0, 0, 0]]),
+             _op("tail", "myadd", [[0, 0, 0]])]
+    graph = _graph_json(nodes, [[2, 0, 0], [3, 0, 0]], [(n,), (1,), (n,), (n,)],
+                        ["float32", "int32", "float32", "float32"],
+                        gate=[-1, -1, 1, -1], device_index=[0, 0, 1, 1])
+
+    if not _llvm_enabled():
+        return
+    mlib = tvm.build([fadd, fcond], "llvm")
+    mod = graph_runtime.create(graph, mlib, [tvm.cpu(0), tvm.cpu(1)])
+    for value in [0.9, 0.1, 0.2, 0.8]:
+        a = np.full((n,), value, dtype=A.dtype)
+        mod.run(x=a)
+        # the tail sees the input of this run even when the head is skipped.
+        out = mod.get_output(1, tvm.nd.empty((n,)))
+        np.testing.assert_allclose(out.asnumpy(), a + 1)
+
+def test_graph_shared_arena():
+    n = 256
+    A = tvm.placeholder((n,), name='A')
+    B = tvm.compute(A.shape, lambda *i: A(*i) + 1.0, name='B')
+    s = tvm.create_schedule(B.op)
+
+    nodes = [{"op": "null", "name": "x", "inputs": []}]
+    for i in range(4):
+        nodes.append(_op("add%d" % i, "myadd", [[i, 0, 0]]))
+    graph = _graph_json(nodes, [[4, 0, 0]], [(n,)] * 5)
+
+    if not _llvm_enabled():
+        return
+    mlib = tvm.build(s, [A, B], "llvm", name="myadd")
+    # the three intermediate entries need two buffers, one model at a time.
+    arena = graph_runtime.shared_arena(tvm.cpu(0), 2 * n * 4)
+    mods, inputs = [], []
+    for k in range(3):
+        mod = graph_runtime.create(graph, mlib, tvm.cpu(0))
+        a = np.random.uniform(size=(n,)).astype(A.dtype)
+        mod.set_input(x=a)
+        mod.use_shared_arena(arena, pin=(k == 0))
+        assert mod.memory_footprint() == 2 * n * 4
+        mods.append(mod)
+        inputs.append(a)
+    for _ in range(2):
+        for mod, a in zip(mods, inputs):
+            mod.run()
+            out = mod.get_output(0, tvm.nd.empty((n,)))
+            np.testing.assert_allclose(out.asnumpy(), a + 4, rtol=1e-5)
+    stats = arena.stats()
+    assert stats["allocated_bytes"] <= 2 * n * 4
+    assert stats["num_leases"] == 6
+    # back to owned activations.
+    mods[0].use_shared_arena(None)
+    mods[0].run()
+    out = mods[0].get_output(0, tvm.nd.empty((n,)))
+    np.testing.assert_allclose(out.asnumpy(), inputs[0] + 4, rtol=1e-5)
+
+def test_graph_module_old_runtime():
+    # the runtime of an older remote only has the original functions.
+    class OldModule(object):
+        def __getitem__(self, name):
+            if name not in ("set_input", "run", "get_output", "load_params"):
+                raise AttributeError("Module has no function '%s'" % name)
+            return lambda *args: name
+    mod = graph_runtime.GraphModule(OldModule(), tvm.cpu(0))
+    mod.run()
+    try:
+        mod.memory_footprint()
+        assert False
+    except AttributeError as e:
+        assert "memory_footprint" in str(e)
+
 if __name__ == "__main__":
     test_graph_simple()
+    test_graph_dynamic_batch()
+    test_graph_fuse_shape_ops()
+    test_graph_heterogeneous()
+    test_graph_quantized_params()
+    test_graph_batcher()
+    test_graph_optimize_order()
+    test_graph_gate()
+    test_graph_gate_heterogeneous()
+    test_graph_shared_arena()
+    test_graph_module_old_runtime()
@@ -1,8 +1,19 @@
 import tvm
 import logging
 import numpy as np
+import hashlib
 import time
-from tvm.contrib import rpc, util
+from tvm.contrib import rpc, rpc_tracker, util
+
+def _wait_summary(client, key, check, timeout=30):
+    """Poll the tracker summary of key until check holds, return it."""
+    deadline = time.time() + timeout
+    while True:
+        summary = client.summary().get(key)
+        if summary is not None and check(summary):
+            return summary
+        assert time.time() < deadline, "tracker state %s" % summary
+        time.sleep(0.05)
 
 def test_rpc_simple():
     if not tvm.module.enabled("rpc"):
@@ -47,6 +58,16 @@ def test_rpc_array():
     np.testing.assert_equal(r_cpu.asnumpy(), x)
     fremote = remote.get_function("rpc.test.remote_array_func")
     fremote(r_cpu)
+    # payloads larger than the receive buffer land in place.
+    big = np.random.uniform(size=(1 << 20,)).astype("float32")
+    r_big = tvm.nd.array(big, remote.cpu(0))
+    np.testing.assert_equal(r_big.asnumpy(), big)
+    # chunked transfer
+    remote.set_chunk_size(4096)
+    r_big.copyfrom(big + 1)
+    np.testing.assert_equal(r_big.asnumpy(), big + 1)
+    remote.set_chunk_size(0)
+    np.testing.assert_equal(r_big.asnumpy(), big + 1)
 
 def test_rpc_file_exchange():
     if not tvm.module.enabled("rpc"):
@@ -147,6 +168,214 @@ def test_rpc_return_func():
     fadd = f1(10)
     assert fadd(12) == 22
 
+def test_rpc_async():
+    if not tvm.module.enabled("rpc"):
+        return
+    @tvm.register_func("rpc.test.async_addone")
+    def addone(x):
+        return x + 1
+    @tvm.register_func("rpc.test.async_except")
+    def remotethrow(name):
+        raise ValueError("%s" % name)
+    server = rpc.Server("localhost")
+    remote = rpc.connect(server.host, server.port)
+    fadd = remote.get_async_function("rpc.test.async_addone")
+    futures = [fadd(i) for i in range(100)]
+    # synchronous calls still work with requests in flight.
+    assert remote.get_function("rpc.test.async_addone")(-1) == 0
+    assert all(f.done() for f in futures)
+    assert [f.result() for f in futures] == list(range(1, 101))
+    fexcept = remote.get_async_function("rpc.test.async_except")
+    ferr = fexcept("abc")
+    fok = fadd(10)
+    try:
+        ferr.result()
+        assert False
+    except tvm.TVMError as e:
+        assert "abc" in str(e)
+    assert fok.result() == 11
+    # pipelined copies
+    x = np.random.uniform(size=(1024,)).astype("float32")
+    r_arr = [tvm.nd.empty(x.shape, x.dtype, remote.cpu(0)) for _ in range(4)]
+    local = [tvm.nd.empty(x.shape, x.dtype) for _ in range(4)]
+    ups = [remote.async_copy(tvm.nd.array(x + i), r) for i, r in enumerate(r_arr)]
+    downs = [remote.async_copy(r, l) for r, l in zip(r_arr, local)]
+    for f in ups + downs:
+        f.result()
+    for i, l in enumerate(local):
+        np.testing.assert_equal(l.asnumpy(), x + i)
+
+def test_rpc_compression():
+    if not tvm.module.enabled("rpc"):
+        return
+    server = rpc.Server("localhost")
+    remote = rpc.connect(server.host, server.port)
+    assert remote.set_compression("byteplane_rle", threshold=1024)
+    x = np.zeros((1 << 16,), dtype="float32")
+    x[::7] = np.random.uniform(size=x[::7].shape)
+    r_x = tvm.nd.array(x, remote.cpu(0))
+    np.testing.assert_equal(r_x.asnumpy(), x)
+    y = np.random.uniform(size=(1000,)).astype("float32")
+    r_x.copyfrom(np.concatenate([y] * (x.size // y.size) + [y[:x.size % y.size]]))
+    np.testing.assert_equal(r_x.asnumpy()[:1000], y)
+    blob = bytearray(np.zeros(10000, dtype="uint8"))
+    remote.upload(blob, "zeros.bin")
+    assert remote.download("zeros.bin") == blob
+    assert remote.set_compression("none")
+    np.testing.assert_equal(r_x.asnumpy()[:1000], y)
+
+def test_rpc_shm():
+    if not tvm.module.enabled("rpc"):
+        return
+    @tvm.register_func("rpc.test.shm_addone")
+    def addone(x):
+        return x + 1
+    server = rpc.Server("localhost", use_shm=True)
+    remote = rpc.connect(server.host, server.port, transport="shm")
+    assert remote.get_function("rpc.test.shm_addone")(10) == 11
+    # larger than the ring buffer of each direction.
+    x = np.random.uniform(size=(3 << 20,)).astype("float32")
+    r_x = tvm.nd.array(x, remote.cpu(0))
+    np.testing.assert_equal(r_x.asnumpy(), x)
+    # servers only accept shared memory when asked to.
+    server = rpc.Server("localhost")
+    try:
+        rpc.connect(server.host, server.port, transport="shm")
+        assert False
+    except tvm.TVMError as e:
+        assert "shared memory" in str(e)
+
+def test_rpc_time_evaluator():
+    if not tvm.module.enabled("rpc"):
+        return
+    @tvm.register_func("rpc.test.sleep")
+    def sleep(ms):
+        time.sleep(ms / 1000.0)
+    server = rpc.Server("localhost")
+    remote = rpc.connect(server.host, server.port)
+    ctx = remote.cpu(0)
+    # global functions of the session module.
+    ftimer = remote._sess.time_evaluator("rpc.test.sleep", ctx, number=1, repeat=3)
+    res = ftimer(2)
+    assert len(res.results) == 3
+    assert res.min <= res.median <= res.p90 <= res.p99
+    assert res.median >= 0.002
+    ftimer = remote._sess.time_evaluator(
+        "rpc.test.sleep", ctx, number=1, repeat=2, max_repeat=20,
+        rel_ci=0.5, flush_cache_bytes=1 << 20)
+    res = ftimer(1)
+    assert 2 <= len(res.results) <= 20
+    assert res.num_outliers < len(res.results)
+    # counters may be refused by the system, but are always reported.
+    ftimer = remote._sess.time_evaluator(
+        "rpc.test.sleep", ctx, number=2, repeat=3, counters=["cycles", "task-clock"])
+    res = ftimer(1)
+    assert sorted(res.counters.keys()) == ["cycles", "task-clock"]
+    assert all(len(v) == 3 for v in res.counters.values())
+
+def test_rpc_multiplex():
+    if not tvm.module.enabled("rpc"):
+        return
+    @tvm.register_func("rpc.test.mux_addone")
+    def addone(x):
+        return x + 1
+    server = rpc.Server("localhost")
+    remote = rpc.connect(server.host, server.port, multiplex=True)
+    sessions = [remote] + [remote.new_session() for _ in range(3)]
+    for i, sess in enumerate(sessions):
+        assert sess.get_function("rpc.test.mux_addone")(i) == i + 1
+    # files are shared by the sessions of the connection.
+    remote.upload(bytearray([1, 2, 3]), "mux.dat")
+    assert sessions[2].download("mux.dat") == bytearray([1, 2, 3])
+    x = np.random.uniform(size=(1 << 20,)).astype("float32")
+    arrays = [tvm.nd.array(x, sess.cpu(0)) for sess in sessions]
+    for r_x in arrays:
+        np.testing.assert_equal(r_x.asnumpy(), x)
+    # closing one session leaves the others usable.
+    del arrays
+    sessions.pop()
+    assert sessions[-1].get_function("rpc.test.mux_addone")(1) == 2
+    # plain connections cannot open more sessions.
+    plain = rpc.connect(server.host, server.port)
+    try:
+        plain.new_session()
+        assert False
+    except tvm.TVMError as e:
+        assert "multiplex" in str(e)
+
+def test_rpc_tracker():
+    if not tvm.module.enabled("rpc"):
+        return
+    @tvm.register_func("rpc.test.tracker_addone")
+    def addone(x):
+        return x + 1
+    tracker = rpc_tracker.Tracker("localhost")
+    tracker_addr = (tracker.host, tracker.port)
+    servers = [rpc.Server("localhost", key="board", tracker_addr=tracker_addr)
+               for _ in range(2)]
+    client = rpc_tracker.connect_tracker(tracker.host, tracker.port)
+    _wait_summary(client, "board", lambda s: s["free"] == 2)
+    s1 = client.request("board")
+    s2 = client.request("board")
+    assert s1.get_function("rpc.test.tracker_addone")(1) == 2
+    summary = client.summary()["board"]
+    assert summary["busy"] == 2 and summary["served"] == 2
+    try:
+        client.request("board", timeout=0.2)
+        assert False
+    except RuntimeError as e:
+        assert "board" in str(e)
+    # a client that leaves while waiting does not hold a server.
+    sock = rpc_tracker._connect_tracker(tracker_addr)
+    rpc_tracker._send_msg(sock, [rpc_tracker.TrackerCode.REQUEST, "board", 0, -1])
+    _wait_summary(client, "board", lambda s: s["pending"] == 1)
+    sock.close()
+    _wait_summary(client, "board", lambda s: s["pending"] == 0)
+    # the device goes back to the pool once the session closes.
+    del s1
+    s3 = client.request("board", timeout=10, priority=1)
+    assert s3.get_function("rpc.test.tracker_addone")(2) == 3
+    del s2, s3
+    summary = _wait_summary(client, "board", lambda s: s["free"] == 2)
+    assert summary["pending"] == 0
+    assert 0 < summary["utilization"] < 1
+
+def test_rpc_module_cache():
+    if not tvm.module.enabled("rpc"):
+        return
+    server = rpc.Server("localhost")
+    remote = rpc.connect(server.host, server.port)
+    blob = bytearray(np.random.randint(0, 10, size=(10)))
+    remote.upload(blob, "dat.bin", cache=True)
+    assert remote.download("dat.bin") == blob
+    # the cache outlives the session.
+    remote = rpc.connect(server.host, server.port)
+    name = hashlib.sha256(blob).hexdigest() + ".bin"
+    lookup = remote.get_function("tvm.contrib.rpc.server.cache_lookup")
+    assert lookup(name, "dat2.bin")
+    # only names made of a hash and an extension are looked up.
+    assert not lookup("../" + name, "dat3.bin")
+    assert not lookup("..", "dat3.bin")
+    assert remote.download("dat2.bin") == blob
+    if not tvm.module.enabled("llvm"):
+        return
+    temp = util.tempdir()
+    n = tvm.convert(1024)
+    A = tvm.placeholder((n,), name='A')
+    B = tvm.compute(A.shape, lambda *i: A(*i) + 1.0, name='B')
+    s = tvm.create_schedule(B.op)
+    f = tvm.build(s, [A, B], "llvm", name="myadd")
+    path_obj = temp.relpath("dev_lib.o")
+    f.save(path_obj)
+    for _ in range(2):
+        remote = rpc.connect(server.host, server.port)
+        remote.upload(path_obj, cache=True)
+        f1 = remote.load_module("dev_lib.o")
+        a = tvm.nd.array(np.random.uniform(size=1024).astype(A.dtype), remote.cpu(0))
+        b = tvm.nd.array(np.zeros(1024, dtype=A.dtype), remote.cpu(0))
+        f1(a, b)
+        np.testing.assert_equal(b.asnumpy(), a.asnumpy() + 1)
+
 
 if __name__ == "__main__":
     logging.basicConfig(level=logging.INFO)
@@ -155,3 +384,10 @@ if __name__ == "__main__":
     test_rpc_file_exchange()
     test_rpc_array()
     test_rpc_simple()
+    test_rpc_async()
+    test_rpc_compression()
+    test_rpc_shm()
+    test_rpc_time_evaluator()
+    test_rpc_multiplex()
+    test_rpc_tracker()
+    test_rpc_module_cache()